@@ -0,0 +1,231 @@
+#include <util/atomic.h>
+#include "config.h"
+#include "autotune.h"
+#include "encoder.h"
+#include "speed_control.h"
+#include "stored_settings.h"
+#include "control_timer.h"
+#include "current_state.h"
+#include "serial.h"
+
+#define AUTOTUNE_CAPTURE_TICKS_PER_SAMPLE (CONTROL_TIMER_TICKS_PER_SECOND / AUTOTUNE_CAPTURE_FREQUENCY_HZ)
+
+//The speed at the end is measured over the last quarter of the capture, which must fit in one Timer5 wrap
+static_assert(AUTOTUNE_CAPTURE_SAMPLES / 4 * AUTOTUNE_CAPTURE_TICKS_PER_SAMPLE < 0xFFFF, "AUTOTUNE_CAPTURE_SAMPLES is too long for the capture frequency");
+
+//Samples used for the rising speed when looking for the time constant
+#define AUTOTUNE_SPEED_WINDOW 5
+
+typedef enum {
+  AUTOTUNE_IDLE,
+  AUTOTUNE_SETTLING,
+  AUTOTUNE_CAPTURING,
+  AUTOTUNE_SENDING
+} autotuneState_t;
+
+autotuneState_t autotuneState = AUTOTUNE_IDLE;
+uint8_t autotuneEncoder = 1;
+unsigned long autotuneTimeAtSettle = 0;
+uint16_t nextAutotuneSampleToSend = 0;
+bool autotuneSucceeded = true;
+wheelSpeedGains_t autotuneGains[2];
+
+autotuneSample_t autotuneCapture[AUTOTUNE_CAPTURE_SAMPLES];
+volatile uint16_t capturedAutotuneSamples = AUTOTUNE_CAPTURE_SAMPLES;
+volatile int16_t autotunePwm = 0;
+long autotunePulsesAtStep = 0;
+
+static long getAutotuneEncoderPulses(){
+  return autotuneEncoder == 1 ? getEncoder1Pulses() : getEncoder2Pulses();
+}
+
+static void setAutotunePwm(int16_t pwm){
+  autotunePwm = pwm;
+  setWheelPwmTargets(autotuneEncoder == 1 ? pwm : 0, autotuneEncoder == 2 ? pwm : 0);
+}
+
+//Compare B shares the free running Timer5 with the wheel control step and is only enabled during a capture
+static void startAutotuneCapture(){
+  autotunePulsesAtStep = getAutotuneEncoderPulses();
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    capturedAutotuneSamples = 0;
+    OCR5B = TCNT5 + AUTOTUNE_CAPTURE_TICKS_PER_SAMPLE;
+    TIFR5 = _BV(OCF5B);
+    TIMSK5 |= _BV(OCIE5B);
+  }
+}
+
+ISR(TIMER5_COMPB_vect){
+  uint16_t sampleIndex = capturedAutotuneSamples;
+  if(sampleIndex >= AUTOTUNE_CAPTURE_SAMPLES){
+    TIMSK5 &= ~_BV(OCIE5B);
+    return;
+  }
+  OCR5B += AUTOTUNE_CAPTURE_TICKS_PER_SAMPLE;
+
+  autotuneSample_t *sample = &autotuneCapture[sampleIndex];
+  sample->timerTicks = TCNT5;
+  sample->pwm = autotunePwm;
+  sample->pulses = getAutotuneEncoderPulses() - autotunePulsesAtStep;
+  capturedAutotuneSamples = sampleIndex + 1;
+}
+
+static float ticksToSeconds(unsigned long ticks){
+  return ticks / (float)CONTROL_TIMER_TICKS_PER_SECOND;
+}
+
+/*
+ * Fits a first order model with dead time to the capture: the steady speed from the last quarter, the dead time up to
+ * the first movement and the time constant from there to 63 % of the steady speed. Lambda tuning then gives
+ * kp = timeConstant / (gain * (lambda + deadTime)) and ki = kp / timeConstant, with the closed loop time constant lambda
+ * set relative to the open loop one. The feedforward is the inverse of the gain.
+ * kp and ki are limited to AUTOTUNE_MAX_GAIN before they are stored or reported.
+ */
+static void calculateAutotuneResult(autotuneResult_t *result, wheelSpeedGains_t *gains){
+  float millimeterPerCount = getEncoderMillimeterPerCount(autotuneEncoder);
+  const uint16_t lastSample = AUTOTUNE_CAPTURE_SAMPLES - 1;
+  const uint16_t steadyStart = AUTOTUNE_CAPTURE_SAMPLES * 3 / 4;
+  int16_t stepPwm = autotuneCapture[0].pwm;
+
+  uint16_t steadyTicks = autotuneCapture[lastSample].timerTicks - autotuneCapture[steadyStart].timerTicks;
+  float steadySpeed = (autotuneCapture[lastSample].pulses - autotuneCapture[steadyStart].pulses) * millimeterPerCount / ticksToSeconds(steadyTicks);
+
+  memset(result, 0, sizeof(autotuneResult_t));
+  result->encoderNumber = autotuneEncoder;
+  result->steadySpeed = steadySpeed;
+  if(fabs(steadySpeed) < AUTOTUNE_MIN_SPEED_MM_S){
+    result->status = AUTOTUNE_NO_MOVEMENT;
+    return;
+  }
+  if((steadySpeed > 0) != (stepPwm > 0)){
+    result->status = AUTOTUNE_WRONG_DIRECTION;
+    return;
+  }
+
+  //Elapsed time is summed sample by sample since the 16-bit timer wraps during the capture
+  unsigned long elapsedTicks = 0;
+  unsigned long deadTimeTicks = 0;
+  unsigned long riseTimeTicks = 0;
+  bool moving = false;
+  for(uint16_t i = 1; i <= lastSample; i++){
+    elapsedTicks += (uint16_t)(autotuneCapture[i].timerTicks - autotuneCapture[i - 1].timerTicks);
+    if(!moving && abs(autotuneCapture[i].pulses) >= 2){
+      moving = true;
+      deadTimeTicks = elapsedTicks;
+    }
+    if(moving && i >= AUTOTUNE_SPEED_WINDOW){
+      const autotuneSample_t *windowStart = &autotuneCapture[i - AUTOTUNE_SPEED_WINDOW];
+      uint16_t windowTicks = autotuneCapture[i].timerTicks - windowStart->timerTicks;
+      float speed = (autotuneCapture[i].pulses - windowStart->pulses) * millimeterPerCount / ticksToSeconds(windowTicks);
+      if(fabs(speed) >= 0.632 * fabs(steadySpeed)){
+        //The window speed belongs to the middle of the window
+        riseTimeTicks = elapsedTicks - windowTicks / 2;
+        break;
+      }
+    }
+  }
+
+  float deadTime = ticksToSeconds(deadTimeTicks);
+  float timeConstant = ticksToSeconds(riseTimeTicks > deadTimeTicks ? riseTimeTicks - deadTimeTicks : 0);
+  if(timeConstant < 1.0 / AUTOTUNE_CAPTURE_FREQUENCY_HZ){
+    timeConstant = 1.0 / AUTOTUNE_CAPTURE_FREQUENCY_HZ;
+  }
+  float gain = steadySpeed / (stepPwm - (stepPwm > 0 ? WHEEL_SPEED_FEEDFORWARD_STATIC_PWM : -WHEEL_SPEED_FEEDFORWARD_STATIC_PWM));
+  float lambda = timeConstant * AUTOTUNE_CLOSED_LOOP_TIME_FACTOR;
+
+  //A time constant at its floor gives a huge ki, both gains are limited so they stay usable and fit the result fields
+  gains->kp = constrain(timeConstant / (gain * (lambda + deadTime)), 0, AUTOTUNE_MAX_GAIN);
+  gains->ki = constrain(gains->kp / timeConstant, 0, AUTOTUNE_MAX_GAIN);
+  gains->feedforwardPwmPerMmS = 1 / gain;
+
+  result->status = AUTOTUNE_OK;
+  result->deadTimeMs = deadTime * 1000;
+  result->timeConstantMs = timeConstant * 1000;
+  result->kpMilli = gains->kp * 1000;
+  result->kiMilli = gains->ki * 1000;
+  result->feedforwardMilli = gains->feedforwardPwmPerMmS * 1000;
+}
+
+static void finishAutotune(){
+  setWheelSpeedTargets(0, 0);
+  if(autotuneSucceeded){
+    for(uint8_t wheel = 0; wheel < 2; wheel++){
+      getStoredSettings()->wheelSpeedGains[wheel] = autotuneGains[wheel];
+      setWheelSpeedGains(wheel + 1, &autotuneGains[wheel]);
+    }
+    saveStoredSettings();
+  }
+  autotuneState = AUTOTUNE_IDLE;
+  setCurrentState(STANDBY);
+}
+
+//A run that was left for standby is simply started over
+bool startAutotune(){
+  if(getCurrentState() != STANDBY){
+    return false;
+  }
+  setCurrentState(AUTOTUNE);
+  autotuneEncoder = 1;
+  autotuneSucceeded = true;
+  setAutotunePwm(0);
+  autotuneTimeAtSettle = millis();
+  autotuneState = AUTOTUNE_SETTLING;
+  return true;
+}
+
+void doAutotuneTick(){
+  switch(autotuneState){
+    case(AUTOTUNE_IDLE):
+      setCurrentState(STANDBY);
+      break;
+
+    case(AUTOTUNE_SETTLING):
+      if(millis() - autotuneTimeAtSettle >= AUTOTUNE_SETTLE_MS){
+        setAutotunePwm(AUTOTUNE_STEP_PWM);
+        startAutotuneCapture();
+        autotuneState = AUTOTUNE_CAPTURING;
+      }
+      break;
+
+    case(AUTOTUNE_CAPTURING):
+      if(capturedAutotuneSamples >= AUTOTUNE_CAPTURE_SAMPLES){
+        setAutotunePwm(0);
+        nextAutotuneSampleToSend = 0;
+        autotuneState = AUTOTUNE_SENDING;
+      }
+      break;
+
+    //Sent in the background like the profile, the result follows the last sample
+    case(AUTOTUNE_SENDING):{
+      for(uint8_t i = 0; i < AUTOTUNE_SAMPLES_PER_TICK && nextAutotuneSampleToSend < AUTOTUNE_CAPTURE_SAMPLES; i++){
+        if(!sendAutotuneSampleTransmission(autotuneEncoder, nextAutotuneSampleToSend, &autotuneCapture[nextAutotuneSampleToSend])){
+          return;
+        }
+        nextAutotuneSampleToSend++;
+      }
+      if(nextAutotuneSampleToSend < AUTOTUNE_CAPTURE_SAMPLES){
+        return;
+      }
+
+      //Only depends on the capture, so it is simply calculated again while the result does not fit yet
+      autotuneResult_t result;
+      calculateAutotuneResult(&result, &autotuneGains[autotuneEncoder - 1]);
+      if(!sendAutotuneResultTransmission(&result)){
+        return;
+      }
+      if(result.status != AUTOTUNE_OK){
+        autotuneSucceeded = false;
+      }
+
+      if(autotuneEncoder == 2){
+        finishAutotune();
+        return;
+      }
+      autotuneEncoder = 2;
+      setAutotunePwm(0);
+      autotuneTimeAtSettle = millis();
+      autotuneState = AUTOTUNE_SETTLING;
+      break;
+    }
+  }
+}
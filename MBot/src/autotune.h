@@ -0,0 +1,64 @@
+/**
+ * @file autotune.h
+ * @brief Header file containing the automatic tuning of the wheel speed controllers.
+ */
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+/**
+ * @brief This module finds the speed controller gains of both wheels with a step test, one wheel at a time.
+ * After a standstill the wheel gets a fixed PWM step while a Timer5 compare B interrupt captures the PWM, pulse count
+ * and time at AUTOTUNE_CAPTURE_FREQUENCY_HZ into RAM. The capture is then sent to the Pi, and a first order model with
+ * dead time (gain, time constant, dead time) is fitted to it. The PI gains follow from lambda tuning of that model and
+ * the feedforward from its gain. When both wheels succeed the gains are used right away and saved in EEPROM.
+ *
+ * The Pi starts it with "tune" in standby, the robot is in the AUTOTUNE state until it is done and should be lifted.
+ */
+
+#include <Arduino.h>
+
+/**
+ * @brief Enum defining the outcome of the step test of one wheel.
+ */
+typedef enum {
+  AUTOTUNE_OK, /**< Gains were calculated */
+  AUTOTUNE_NO_MOVEMENT, /**< The wheel did not reach AUTOTUNE_MIN_SPEED_MM_S */
+  AUTOTUNE_WRONG_DIRECTION /**< The pulse count ran against the PWM, the motor or encoder is wired the wrong way */
+} autotuneStatus_t;
+
+/**
+ * @brief Struct holding one captured sample.
+ */
+typedef struct __attribute__((packed)) {
+  uint16_t timerTicks; /**< Timer5 count, 4 microsecond ticks wrapping every 262 ms */
+  int16_t pwm; /**< PWM applied to the motor */
+  int16_t pulses; /**< Pulse count since the start of the step */
+} autotuneSample_t;
+
+/**
+ * @brief Struct holding the result of one wheel, sent as is in the binary protocol.
+ */
+typedef struct __attribute__((packed)) {
+  uint8_t encoderNumber; /**< The encoder of the wheel, 1 or 2 */
+  uint8_t status; /**< See autotuneStatus_t */
+  int16_t steadySpeed; /**< Speed at the end of the step in mm/s */
+  uint16_t deadTimeMs; /**< Time from the step to the first movement */
+  uint16_t timeConstantMs; /**< Time from the first movement to 63 % of the steady speed */
+  int16_t kpMilli; /**< Proportional gain times 1000 */
+  int16_t kiMilli; /**< Integral gain times 1000 */
+  int16_t feedforwardMilli; /**< Feedforward gain times 1000 */
+} autotuneResult_t;
+
+/**
+ * @brief Starts the autotune, only possible in standby.
+ * @return True if the autotune was started.
+ */
+bool startAutotune();
+
+/**
+ * @brief Performs a tick of the autotune, run by the motor control task in the AUTOTUNE state.
+ */
+void doAutotuneTick();
+
+#endif // AUTOTUNE_H
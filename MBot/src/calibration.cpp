@@ -0,0 +1,162 @@
+#include "config.h"
+#include "calibration.h"
+#include "encoder.h"
+#include "gyro.h"
+#include "motorcontrol.h"
+#include "stored_settings.h"
+#include "current_state.h"
+#include "serial.h"
+
+typedef enum {
+  CALIBRATION_IDLE,
+  CALIBRATION_SETTLING_BEFORE_ROTATION,
+  CALIBRATION_ROTATING,
+  CALIBRATION_SETTLING_AFTER_ROTATION,
+  CALIBRATION_DRIVING,
+  CALIBRATION_SETTLING_AFTER_DRIVE
+} calibrationState_t;
+
+calibrationState_t calibrationState = CALIBRATION_IDLE;
+unsigned long calibrationTimeAtSettle = 0;
+
+//Turned angle since the start of the measurement, from the unwrapped gyro heading
+float calibrationAngle = 0;
+float calibrationStartHeading = 0;
+
+encoderSnapshot_t calibrationStart;
+long rotationCounts[2];
+long driveCounts[2];
+float rotationDegrees = 0;
+
+static void updateCalibrationAngle(){
+  calibrationAngle = getGyroHeading() - calibrationStartHeading;
+}
+
+static void startCalibrationMeasurement(){
+  getEncoderSnapshot(&calibrationStart);
+  calibrationAngle = 0;
+  calibrationStartHeading = getGyroHeading();
+}
+
+static void getCalibrationCounts(long *counts){
+  encoderSnapshot_t snapshot;
+  getEncoderSnapshot(&snapshot);
+  counts[0] = abs(snapshot.encoder1Pulses - calibrationStart.encoder1Pulses);
+  counts[1] = abs(snapshot.encoder2Pulses - calibrationStart.encoder2Pulses);
+}
+
+static void startCalibrationSettle(calibrationState_t settleState){
+  setMotorTargets(NONE, 0);
+  calibrationTimeAtSettle = millis();
+  calibrationState = settleState;
+}
+
+static bool calibrationSettled(){
+  setMotorTargets(NONE, 0);
+  return millis() - calibrationTimeAtSettle >= CALIBRATION_SETTLE_MS;
+}
+
+/*
+ * Solves the two equations in calibration.h for the ratio of the wheels, with k = psi / theta:
+ *   s2 * (f2 - k * r2) = s1 * (f1 + k * r1)
+ * and scales both so their mean stays at the default distance per pulse.
+ */
+static void calculateCalibrationResult(calibrationResult_t *result, float headingDriftDegrees){
+  memset(result, 0, sizeof(calibrationResult_t));
+  result->rotationDecidegrees = rotationDegrees * 10;
+  result->headingDriftCentidegrees = headingDriftDegrees * 100;
+  if(rotationDegrees < CALIBRATION_ROTATION_DEGREES / 2){
+    result->status = CALIBRATION_NO_ROTATION;
+    return;
+  }
+
+  float k = headingDriftDegrees / rotationDegrees;
+  float ratio = (driveCounts[1] - k * rotationCounts[1]) / (driveCounts[0] + k * rotationCounts[0]);
+  float multiplier = getEncoderDecodingMultiplier();
+  float encoder2MillimeterPerCount = 2.0 * MILLIMETER_PER_ENCOER_PULSE / multiplier / (1 + ratio);
+  float encoder1MillimeterPerCount = ratio * encoder2MillimeterPerCount;
+  float trackWidth = (encoder1MillimeterPerCount * rotationCounts[0] + encoder2MillimeterPerCount * rotationCounts[1]) /
+                     (rotationDegrees * DEGREES_TO_RADIAN_FACTOR);
+
+  result->encoder1PulseLength = encoder1MillimeterPerCount * multiplier * 100000;
+  result->encoder2PulseLength = encoder2MillimeterPerCount * multiplier * 100000;
+  result->trackWidthTenthMm = trackWidth * 10;
+  //Written so that a NaN from a robot that did not drive fails as well
+  if(!(ratio <= CALIBRATION_MAX_WHEEL_RATIO && ratio >= 1 / CALIBRATION_MAX_WHEEL_RATIO &&
+       trackWidth >= WHEEL_TRACK_WIDTH_MM / 2 && trackWidth <= WHEEL_TRACK_WIDTH_MM * 2)){
+    result->status = CALIBRATION_OUT_OF_RANGE;
+    return;
+  }
+
+  storedSettings_t *settings = getStoredSettings();
+  settings->millimeterPerPulse[0] = encoder1MillimeterPerCount * multiplier;
+  settings->millimeterPerPulse[1] = encoder2MillimeterPerCount * multiplier;
+  setEncoderMillimeterPerPulse(1, settings->millimeterPerPulse[0]);
+  setEncoderMillimeterPerPulse(2, settings->millimeterPerPulse[1]);
+  saveStoredSettings();
+  result->status = CALIBRATION_OK;
+}
+
+//A run that was left for standby is simply started over
+bool startCalibration(){
+  if(getCurrentState() != STANDBY){
+    return false;
+  }
+  setCurrentState(CALIBRATION);
+  startCalibrationSettle(CALIBRATION_SETTLING_BEFORE_ROTATION);
+  return true;
+}
+
+void doCalibrationTick(){
+  updateCalibrationAngle();
+
+  switch(calibrationState){
+    case(CALIBRATION_IDLE):
+      setCurrentState(STANDBY);
+      break;
+
+    case(CALIBRATION_SETTLING_BEFORE_ROTATION):
+      if(calibrationSettled()){
+        startCalibrationMeasurement();
+        calibrationState = CALIBRATION_ROTATING;
+      }
+      break;
+
+    case(CALIBRATION_ROTATING):
+      setMotorTargets(LEFT, CALIBRATION_SPEED_MM_S);
+      if(fabs(calibrationAngle) >= CALIBRATION_ROTATION_DEGREES){
+        startCalibrationSettle(CALIBRATION_SETTLING_AFTER_ROTATION);
+      }
+      break;
+
+    case(CALIBRATION_SETTLING_AFTER_ROTATION):
+      if(calibrationSettled()){
+        getCalibrationCounts(rotationCounts);
+        rotationDegrees = fabs(calibrationAngle);
+        startCalibrationMeasurement();
+        calibrationState = CALIBRATION_DRIVING;
+      }
+      break;
+
+    case(CALIBRATION_DRIVING):{
+      setMotorTargets(FORWARD, CALIBRATION_SPEED_MM_S);
+      long counts[2];
+      getCalibrationCounts(counts);
+      if((counts[0] * getEncoderMillimeterPerCount(1) + counts[1] * getEncoderMillimeterPerCount(2)) / 2 >= CALIBRATION_DRIVE_DISTANCE_MM){
+        startCalibrationSettle(CALIBRATION_SETTLING_AFTER_DRIVE);
+      }
+      break;
+    }
+
+    case(CALIBRATION_SETTLING_AFTER_DRIVE):
+      if(calibrationSettled()){
+        getCalibrationCounts(driveCounts);
+        calibrationResult_t result;
+        calculateCalibrationResult(&result, calibrationAngle);
+        sendCalibrationResultTransmission(&result);
+        calibrationState = CALIBRATION_IDLE;
+        setCurrentState(STANDBY);
+      }
+      break;
+  }
+}
@@ -0,0 +1,58 @@
+/**
+ * @file calibration.h
+ * @brief Header file containing the calibration of the wheel geometry.
+ */
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+/**
+ * @brief This module measures the distance per pulse of each wheel and the track width, with the gyro as reference.
+ * The robot first turns CALIBRATION_ROTATION_DEGREES in place and then drives CALIBRATION_DRIVE_DISTANCE_MM straight,
+ * standing still before and after each move so the coasting is measured as well. With s1 and s2 the distance per count
+ * of the right (encoder 1) and left (encoder 2) wheel, r and f their counts while turning and driving, theta the angle
+ * turned and psi the heading change while driving (positive to the right):
+ *   turning:  s1 * r1 + s2 * r2 = track * theta
+ *   driving:  s2 * f2 - s1 * f1 = track * psi
+ * The gyro only gives angles, so the mean of s1 and s2 is kept at the MILLIMETER_PER_ENCOER_PULSE default, which follows
+ * from the wheel diameter. The distances per pulse are used right away and saved in EEPROM. The heading comes from the
+ * gyro, so the track width is only reported and used as a plausibility check.
+ *
+ * The Pi starts it with "cal" in standby, the robot is in the CALIBRATION state until it is done.
+ */
+
+#include <Arduino.h>
+
+/**
+ * @brief Enum defining the outcome of a calibration.
+ */
+typedef enum {
+  CALIBRATION_OK, /**< The calibration was saved */
+  CALIBRATION_NO_ROTATION, /**< The gyro measured less than half of the rotation */
+  CALIBRATION_OUT_OF_RANGE /**< The wheel ratio or track width is implausible */
+} calibrationStatus_t;
+
+/**
+ * @brief Struct holding the result of a calibration, sent as is in the binary protocol.
+ */
+typedef struct __attribute__((packed)) {
+  uint8_t status; /**< See calibrationStatus_t */
+  uint16_t encoder1PulseLength; /**< Distance per pulse of the right wheel in units of 10 nm, 0.353 mm is 35300 */
+  uint16_t encoder2PulseLength; /**< Distance per pulse of the left wheel in units of 10 nm */
+  uint16_t trackWidthTenthMm; /**< Track width in tenths of a millimeter */
+  int16_t rotationDecidegrees; /**< Angle turned in place in tenths of a degree */
+  int16_t headingDriftCentidegrees; /**< Heading change while driving straight in hundredths of a degree */
+} calibrationResult_t;
+
+/**
+ * @brief Starts the calibration, only possible in standby.
+ * @return True if the calibration was started.
+ */
+bool startCalibration();
+
+/**
+ * @brief Performs a tick of the calibration, run by the motor control task in the CALIBRATION state.
+ */
+void doCalibrationTick();
+
+#endif // CALIBRATION_H
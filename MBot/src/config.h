@@ -10,31 +10,120 @@
 //Serial defines
 #define SERIAL_UPDATE_FREQUENCY_MS 50
 #define MAX_ALLOWED_MISSED_SERIAL_TICKS 8 //determined only by testing, 5 is not enough
+#define SERIAL_COMMAND_BUFFER_SIZE 32 //longest command accepted, including the terminating '\0'
+#define SERIAL_BINARY_LINK_TIMEOUT_MS 5000 //a binary link without a valid frame for this long falls back to ASCII, the Pi sends a keepalive every second
+#define SERIAL_LINE_BUFFER_SIZE 96 //longest ASCII line sent to the Pi (a profile report), including the line ending
+#define PROTOCOL_MAX_PAYLOAD_SIZE 32 //largest payload of a binary frame, see protocol.h
+#define UART_RX_BUFFER_SIZE 256 //receive ring buffer of the Pi serial port, power of two, at most 256
+#define UART_TX_BUFFER_SIZE 128 //transmit ring buffer of the Pi serial port, power of two, at most 256
 
 //Motor constants
-#define LOCALIZATION_CIRCLE_ROTATION_OFFSET 90.0
-
 #define ROTATING_LEFT_MOMENTUM_OFFSET 13
 #define ROTATING_RIGHT_MOMENTUM_OFFSET 13
 
-#define AUTONOMOUS_LOCATION_TICK_TIME_MS 1000
-
 #define MILLIMETER_DISTANCE_WHEN_FREE_ROLLING_AFTER_FULL_SPEED 45
 
 #define MANUAL_MOTOR_SPEED_HIGH_PERCENTAGE 100
 #define MANUAL_MOTOR_SPEED_MEDIUM_PERCENTAGE 60
 #define MANUAL_MOTOR_SPEED_LOW_PERCENTAGE 40
+#define MOTOR_SPEED_AUTONOMOUS_FORWARD 60 //percentage used by the driving tests in testing_code.cpp
 
 #define PERCENTAGE_TO_PWM_FACTOR 2.55
 #define MOTOR_DEVIATION_FACTOR 0.95
 #define DEGREES_TO_RADIAN_FACTOR M_PI/180
 
-#define MILLIMETER_PER_ENCOER_PULSE 0.353
-#define ENCODER_PULSE_PER_MILLIMETER 2.832
+#define MILLIMETER_PER_ENCOER_PULSE 0.353 //Default for both wheels until the calibration has stored its own
+#define WHEEL_TRACK_WIDTH_MM 150.0 //Nominal distance between the wheels, the calibration rejects a measured track width far from it
 #define ENCODER_LIBRARY_PWM_OFFSET_VALUE 2
+#define ENCODER_DECODING_MULTIPLIER 4 //1 counts rising edges of channel A, 2 both edges of A, 4 all edges of A and B (2 is used when B has no interrupt)
 
 #define MAX_MOTOR_SPEED 255
 #define HALF_MOTOR_SPEED 255*0.5
 
-//Temperature
-#define NUMBER_OF_TICKS_BETWEEN_TEMPERATURE_TRANSMISSION 20
\ No newline at end of file
+//Wheel control
+#define USE_WHEEL_CONTROL_TIMER 1 //1 runs the wheel control step from Timer5, 0 from the motor control task
+#define WHEEL_CONTROL_FREQUENCY_HZ 200
+#define WHEEL_SPEED_TIMEOUT_MS 100 //A wheel without an encoder edge for this long is standing still
+
+//Wheel speed control, speeds in millimeters per second
+#define WHEEL_MAX_SPEED_MM_PER_S 350 //Fastest commanded wheel speed, kept below the full PWM speed for headroom on a low battery
+#define WHEEL_SPEED_AT_FULL_PWM_MM_S 450 //Wheel speed at full PWM on a charged battery
+#define PERCENTAGE_TO_WHEEL_SPEED_FACTOR (WHEEL_MAX_SPEED_MM_PER_S / 100.0)
+#define WHEEL_SPEED_FEEDFORWARD_STATIC_PWM 20 //PWM needed to overcome the static friction of the motors
+#define WHEEL_SPEED_FEEDFORWARD_PWM_PER_MM_S ((MAX_MOTOR_SPEED - WHEEL_SPEED_FEEDFORWARD_STATIC_PWM) / (float)WHEEL_SPEED_AT_FULL_PWM_MM_S)
+#define WHEEL_SPEED_KP 0.4 //PWM per mm/s of speed error, default until the autotune has stored gains
+#define WHEEL_SPEED_KI 4.0 //PWM per mm of accumulated speed error, default until the autotune has stored gains
+
+//Autotune, step test of one wheel at a time, the robot should be lifted so the wheels run freely
+#define AUTOTUNE_STEP_PWM 150
+#define AUTOTUNE_SETTLE_MS 500 //Standstill before each step
+#define AUTOTUNE_CAPTURE_FREQUENCY_HZ 500
+#define AUTOTUNE_CAPTURE_SAMPLES 256 //6 bytes each, 512 ms at 500 Hz
+#define AUTOTUNE_SAMPLES_PER_TICK 4 //Samples sent per motor control tick when dumping the capture
+#define AUTOTUNE_MIN_SPEED_MM_S 30 //A wheel slower than this at the end of the step counts as not moving
+#define AUTOTUNE_CLOSED_LOOP_TIME_FACTOR 1.0 //Closed loop time constant relative to the open loop one, lower is more aggressive
+#define AUTOTUNE_MAX_GAIN 32.0 //Upper limit of kp and ki, times 1000 it still fits the int16_t result fields
+
+//PWM sweep, measures the speed of both wheels at evenly spaced PWM levels in both directions, the robot should be lifted
+#define PWM_SPEED_TABLE_SIZE 9 //Levels from 0 to 255, the speed at level 0 is taken as 0
+#define PWM_SWEEP_SETTLE_MS 300 //Time for the wheels to reach the speed of a new level
+#define PWM_SWEEP_MEASURE_MS 300 //Time the speed is measured over at every level
+
+//Calibration, drives on the floor with the gyro as reference, needs about a meter of free space in front of the robot
+#define CALIBRATION_SPEED_MM_S 100
+#define CALIBRATION_ROTATION_DEGREES 720 //Turned in place to find the track width
+#define CALIBRATION_DRIVE_DISTANCE_MM 1000 //Driven straight to find the difference between the wheels
+#define CALIBRATION_SETTLE_MS 1000 //Standstill before and after each move, so coasting is included
+#define CALIBRATION_MAX_WHEEL_RATIO 1.2 //Larger differences between the wheels are taken as a failed calibration
+
+//Gyro, MPU6050 on the Auriga, read in bursts from its FIFO
+#define GYRO_I2C_ADDRESS 0x69
+#define GYRO_I2C_CLOCK_HZ 400000
+#define GYRO_SAMPLE_RATE_HZ 100 //divided down from the 1 kHz output rate of the sensor with its low pass filter on
+#define GYRO_FIFO_BURST_SAMPLES 2 //12 bytes each, the Wire buffer holds 32
+#define GYRO_MAX_SAMPLES_PER_UPDATE 10 //the rest stays in the FIFO for the next update, about 0.8 s fit before it overflows
+#define GYRO_BIAS_SAMPLES 100 //averaged at startup with the robot standing still
+#define GYRO_STATIONARY_MS 500 //time without wheel movement before the robot counts as standing still
+#define GYRO_STATIONARY_MAX_PULSES 1 //encoder counts a standing wheel may jitter by
+#define GYRO_STATIONARY_MAX_RATE_DPS 2.0 //a larger rate while the wheels stand means the robot is moved by hand
+#define GYRO_BIAS_TRACKING_WEIGHT 0.002 //share of every standing sample in the offsets, a time constant of 5 s at 100 Hz
+#define GYRO_TILT_ACCELEROMETER_WEIGHT 0.02 //share of the accelerometer in the X and Y angles at every update
+
+//Odometry uncertainty, grows the covariance sent with the pose
+#define ODOMETRY_DISTANCE_VARIANCE_PER_MM 0.1 //mm^2 per mm driven, about 10 mm standard deviation after a meter
+#define ODOMETRY_HEADING_VARIANCE_PER_S 1e-6 //rad^2 per second, the gyro drift left after the zero rate tracking
+#define ODOMETRY_HEADING_VARIANCE_PER_RAD 1e-4 //rad^2 per radian turned, the scale error of the gyro
+//Pose history, answers "pq:<time ms>" with the pose at that time
+#define POSE_HISTORY_SIZE 64 //at most 255
+#define POSE_HISTORY_ODOMETRY_STEPS 3 //localization ticks per stored pose, 60 ms apart at 50 Hz, 3.84 s of history with 64 poses
+
+//Scheduler, period of each task of the main loop in microseconds
+#define SCHEDULER_MAX_TASKS 8
+#define TASK_SERIAL_PERIOD_US 5000 //200 Hz
+#define TASK_MOTOR_CONTROL_PERIOD_US 10000 //100 Hz
+#define TASK_GYRO_PERIOD_US 10000 //100 Hz
+#define TASK_LOCALIZATION_PERIOD_US 20000 //50 Hz
+#define TASK_LED_PERIOD_US 33333 //30 Hz
+#define TASK_TELEMETRY_PERIOD_US 0 //every pass, telemetry schedules its own streams
+#define TASK_PROFILER_PERIOD_US 10000 //100 Hz, one section of a requested report per tick
+#define TASK_STORED_SETTINGS_PERIOD_US 5000 //200 Hz, one changed EEPROM byte per tick, a byte takes about 3.3 ms
+
+//Profiler
+#define PROFILER_ENABLED 1 //0 removes all run time measurements
+#define PROFILE_HISTOGRAM_BUCKETS 10
+#define PROFILE_HISTOGRAM_FIRST_BUCKET_US 16 //upper limit of the first bucket, doubled for every next bucket
+
+//LEDs
+#define LED_COUNT 12
+#define LED_MAX_FRAME_RATE_HZ 30 //sending a frame blocks interrupts, unchanged frames are never sent
+
+//Telemetry, default period of each stream (0 = off), can be changed from the Pi with "tr:<stream>,<period ms>"
+#define TELEMETRY_TEMPERATURE_PERIOD_MS 1000
+#define TELEMETRY_ENCODERS_PERIOD_MS 0
+#define TELEMETRY_GYRO_PERIOD_MS 0
+#define TELEMETRY_POSE_PERIOD_MS 200
+#define TELEMETRY_LOOP_STATS_PERIOD_MS 1000
+
+#define TELEMETRY_BANDWIDTH_BYTES_PER_SECOND 2000 //about a third of the 57600 baud link, the rest is kept for acks
+#define TELEMETRY_BANDWIDTH_BURST_BYTES 96 //at least the longest telemetry message (the ASCII pose line), or that stream never gets sent
+#define TELEMETRY_TX_RESERVE_BYTES 24 //free space always left in the transmit buffer for acks
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include <util/atomic.h>
+#include "config.h"
+#include "encoder.h"
+#include "control_timer.h"
+
+#define CONTROL_TIMER_TICKS_PER_STEP (1000000UL / WHEEL_CONTROL_FREQUENCY_HZ / CONTROL_TIMER_MICROS_PER_TICK)
+
+static_assert(CONTROL_TIMER_TICKS_PER_STEP <= 0xFFFF, "WHEEL_CONTROL_FREQUENCY_HZ is too low for 16-bit Timer5");
+
+volatile bool controlStepRunning = false;
+volatile uint16_t controlStepOverruns = 0;
+
+/*
+ * Normal mode (the Arduino core starts Timer5 in 8-bit PWM mode for analogWrite() on pins 44-46), free running
+ * so the counter can also be used as a time base. Compare A is always set one step ahead of the last compare.
+ */
+void setupControlTimer(){
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    TCCR5A = 0;
+    TCCR5B = _BV(CS51) | _BV(CS50);
+#if USE_WHEEL_CONTROL_TIMER
+    OCR5A = TCNT5 + CONTROL_TIMER_TICKS_PER_STEP;
+    TIFR5 = _BV(OCF5A);
+    TIMSK5 |= _BV(OCIE5A);
+#endif
+  }
+}
+
+uint16_t getControlStepOverruns(){
+  uint16_t overruns;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    overruns = controlStepOverruns;
+  }
+  return overruns;
+}
+
+ISR(TIMER5_COMPA_vect, ISR_NOBLOCK){
+  //Interrupts are on again here, so this interrupt can come back while the previous step still runs
+  bool previousStepRunning;
+  ATOMIC_BLOCK(ATOMIC_FORCEON){
+    OCR5A += CONTROL_TIMER_TICKS_PER_STEP;
+    previousStepRunning = controlStepRunning;
+    controlStepRunning = true;
+  }
+  if(previousStepRunning){
+    controlStepOverruns++;
+    return;
+  }
+
+  loopEncoders();
+
+  controlStepRunning = false;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file control_timer.h
+ * @brief Header file containing the hardware timer that runs the wheel control step at a fixed rate.
+ */
+
+#ifndef CONTROL_TIMER_H
+#define CONTROL_TIMER_H
+
+/**
+ * @brief This module runs the wheel speed control step from a Timer5 compare interrupt, so its rate does not depend on
+ * how busy the main loop is. Timer1 and Timer2 are used for the motor PWM and Timer0 for millis(), Timer5 is free
+ * (pin 44, OC5C, is only used as a plain output for the RGB LEDs).
+ *
+ * Timer5 runs freely with 4 microsecond ticks and compare A is moved one period forward at every interrupt.
+ * The interrupt re-enables interrupts before the step so the serial port and the encoder pulses are never held up by it.
+ * A step that is still running when the next one is due is not restarted, the missed step is counted as an overrun.
+ * Setting USE_WHEEL_CONTROL_TIMER to 0 in config.h runs the wheel control from the main loop instead, Timer5 is then
+ * still set up as a time base for the encoder edges.
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * @brief Length of one Timer5 tick, prescaler 64 at 16 MHz.
+ */
+#define CONTROL_TIMER_MICROS_PER_TICK 4
+
+/**
+ * @brief Number of Timer5 ticks per second.
+ */
+#define CONTROL_TIMER_TICKS_PER_SECOND (1000000UL / CONTROL_TIMER_MICROS_PER_TICK)
+
+/**
+ * @brief Sets up Timer5 and, when USE_WHEEL_CONTROL_TIMER is set, starts the wheel control interrupt.
+ */
+void setupControlTimer();
+
+/**
+ * @brief Reads the free running Timer5 counter. The 16-bit read is only safe with interrupts off or from an interrupt.
+ * @return Counter value in ticks of CONTROL_TIMER_MICROS_PER_TICK, wraps every 262 ms.
+ */
+static inline uint16_t readControlTimerTicks(){
+  return TCNT5;
+}
+
+/**
+ * @brief Retrieves the number of wheel control steps skipped because the previous step had not finished.
+ * @return Number of overruns.
+ */
+uint16_t getControlStepOverruns();
+
+#endif // CONTROL_TIMER_H
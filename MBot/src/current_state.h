@@ -11,7 +11,10 @@
  */
 typedef enum {
     STANDBY, /**< Robot is in standby state */
-    MANUAL /**< Robot is in manual mode */
+    MANUAL, /**< Robot is in manual mode */
+    AUTOTUNE, /**< Robot is tuning the wheel speed controllers */
+    CALIBRATION, /**< Robot is calibrating the wheel geometry */
+    PWM_SWEEP /**< Robot is measuring the wheel speed at every PWM level */
 } robotState_t;
 
 /**
@@ -1,80 +1,386 @@
 #include "gyro.h"
 #include <Arduino.h>
+#include <util/atomic.h>
 #include "encoder.h"
+#include "serial.h"
+#include "profiler.h"
+#include "control_timer.h"
+#include "speed_control.h"
+#include "stored_settings.h"
 
 MeEncoderOnBoard Encoder_1(SLOT1);  //RNR10
 MeEncoderOnBoard Encoder_2(SLOT2);  //RNR10
 
+//Pulse counts written by the encoder interrupts, the library counters are not used
+volatile long encoder1Pulses = 0;
+volatile long encoder2Pulses = 0;
+
+//Timer5 time of the last edge of each encoder, for the wheel speeds
+volatile uint16_t encoder1EdgeTicks = 0;
+volatile uint16_t encoder2EdgeTicks = 0;
+
+typedef struct {
+  long previousPulses;
+  uint32_t previousEdgeTime;
+  bool standing;
+  float speed;
+} wheelSpeed_t;
+
+wheelSpeed_t encoder1Speed = {0, 0, true, 0};
+wheelSpeed_t encoder2Speed = {0, 0, true, 0};
+
+/*
+ * Timer5 counter extended to 32 bits by the speed update. At CONTROL_TIMER_MICROS_PER_TICK the 16-bit counter wraps
+ * every 262 ms, which the update normally beats by far, but a blocked main loop can hold it back longer.
+ * millis() of the last update tells when that happened and the tick difference can no longer be trusted.
+ */
+uint32_t speedClockTicks = 0;
+uint16_t speedClockLastTicks = 0;
+unsigned long speedClockLastMillis = 0;
+
+#define WHEEL_SPEED_TIMEOUT_TICKS (WHEEL_SPEED_TIMEOUT_MS * 1000UL / CONTROL_TIMER_MICROS_PER_TICK)
+static_assert(WHEEL_SPEED_TIMEOUT_TICKS <= 0xFFFF, "WHEEL_SPEED_TIMEOUT_MS must be shorter than one Timer5 wrap");
+
+//Input registers and bits of the encoder pins, looked up once so the interrupts do not need digitalRead()
+typedef struct {
+  volatile uint8_t *portA;
+  uint8_t maskA;
+  volatile uint8_t *portB;
+  uint8_t maskB;
+  uint8_t previousState; //Channel A in bit 1, channel B in bit 0
+} encoderPins_t;
+
+encoderPins_t encoder1Pins;
+encoderPins_t encoder2Pins;
+
+uint8_t encoderDecodingMultiplier = 1;
+
+//Distance per count of each wheel, from the calibrated distance per pulse and the decoding multiplier
+float encoder1MillimeterPerCount = MILLIMETER_PER_ENCOER_PULSE;
+float encoder2MillimeterPerCount = MILLIMETER_PER_ENCOER_PULSE;
+//The same in fixed point, converted once when set so the odometry steps stay in integer math
+fixed_t encoder1MillimeterPerCountFixed = fixedFromFloat(MILLIMETER_PER_ENCOER_PULSE);
+fixed_t encoder2MillimeterPerCountFixed = fixedFromFloat(MILLIMETER_PER_ENCOER_PULSE);
+
+/*
+ * Count change for every transition, indexed by previous state * 4 + new state. Forward is A rising while B is high
+ * (01, 11, 10, 00), like the single edge decoding. Invalid transitions where both channels changed count nothing.
+ */
+const int8_t quadratureTransition[16] = {
+   0,  1, -1,  0,
+  -1,  0,  0,  1,
+   1,  0,  0, -1,
+   0, -1,  1,  0
+};
+
+static void setupEncoderPins(encoderPins_t *pins, MeEncoderOnBoard *encoder){
+  pins->portA = portInputRegister(digitalPinToPort(encoder->getPortA()));
+  pins->maskA = digitalPinToBitMask(encoder->getPortA());
+  pins->portB = portInputRegister(digitalPinToPort(encoder->getPortB()));
+  pins->maskB = digitalPinToBitMask(encoder->getPortB());
+  pins->previousState = 0;
+}
+
+static inline uint8_t readEncoderState(const encoderPins_t *pins){
+  return ((*pins->portA & pins->maskA) ? 2 : 0) | ((*pins->portB & pins->maskB) ? 1 : 0);
+}
+
+/*
+ * With two times decoding only channel A interrupts, so a change of channel B is never seen on its own. It is taken
+ * as already happened before the A edge by using the new B level in the previous state.
+ */
+static inline int8_t decodeEncoderTransition(encoderPins_t *pins){
+  uint8_t state = readEncoderState(pins);
+  uint8_t previousState = pins->previousState;
+  if(encoderDecodingMultiplier == 2){
+    previousState = (previousState & 2) | (state & 1);
+  }
+  pins->previousState = state;
+  return quadratureTransition[(previousState << 2) | state];
+}
+
+/*
+ * The B pins of the Auriga (42 and 43 on port L) have neither an external nor a pin change interrupt, so four times
+ * decoding falls back to both edges of channel A there. The multiplier in use is kept for scaling the counts.
+ */
 void setupEncoderInterrupts(){
-  attachInterrupt(Encoder_1.getIntNum(), isr_process_encoder1, RISING);
-  attachInterrupt(Encoder_2.getIntNum(), isr_process_encoder2, RISING);
+  setupEncoderPins(&encoder1Pins, &Encoder_1);
+  setupEncoderPins(&encoder2Pins, &Encoder_2);
+
+  encoderDecodingMultiplier = ENCODER_DECODING_MULTIPLIER;
+  if(encoderDecodingMultiplier == 4 && (digitalPinToInterrupt(Encoder_1.getPortB()) == NOT_AN_INTERRUPT ||
+                                        digitalPinToInterrupt(Encoder_2.getPortB()) == NOT_AN_INTERRUPT)){
+    encoderDecodingMultiplier = 2;
+  }
+  setEncoderMillimeterPerPulse(1, getStoredSettings()->millimeterPerPulse[0]);
+  setEncoderMillimeterPerPulse(2, getStoredSettings()->millimeterPerPulse[1]);
+
+  if(encoderDecodingMultiplier == 1){
+    attachInterrupt(Encoder_1.getIntNum(), isr_process_encoder1, RISING);
+    attachInterrupt(Encoder_2.getIntNum(), isr_process_encoder2, RISING);
+    return;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    encoder1Pins.previousState = readEncoderState(&encoder1Pins);
+    encoder2Pins.previousState = readEncoderState(&encoder2Pins);
+  }
+  attachInterrupt(Encoder_1.getIntNum(), isr_decode_encoder1, CHANGE);
+  attachInterrupt(Encoder_2.getIntNum(), isr_decode_encoder2, CHANGE);
+  if(encoderDecodingMultiplier == 4){
+    attachInterrupt(digitalPinToInterrupt(Encoder_1.getPortB()), isr_decode_encoder1, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(Encoder_2.getPortB()), isr_decode_encoder2, CHANGE);
+  }
+}
+
+uint8_t getEncoderDecodingMultiplier(){
+  return encoderDecodingMultiplier;
+}
+
+void setEncoderMillimeterPerPulse(uint8_t encoderNumber, float millimeterPerPulse){
+  float millimeterPerCount = millimeterPerPulse / encoderDecodingMultiplier;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    if(encoderNumber == 1){
+      encoder1MillimeterPerCount = millimeterPerCount;
+      encoder1MillimeterPerCountFixed = fixedFromFloat(millimeterPerCount);
+    }
+    else{
+      encoder2MillimeterPerCount = millimeterPerCount;
+      encoder2MillimeterPerCountFixed = fixedFromFloat(millimeterPerCount);
+    }
+  }
+}
+
+float getEncoderMillimeterPerCount(uint8_t encoderNumber){
+  float millimeterPerCount;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    millimeterPerCount = encoderNumber == 1 ? encoder1MillimeterPerCount : encoder2MillimeterPerCount;
+  }
+  return millimeterPerCount;
+}
+
+//Only set and read outside of interrupts, so no atomic block is needed
+fixed_t getEncoderMillimeterPerCountFixed(uint8_t encoderNumber){
+  return encoderNumber == 1 ? encoder1MillimeterPerCountFixed : encoder2MillimeterPerCountFixed;
 }
 
 //Following two functions are used when reading the pulses generated by the encoders when the motors are moving
 void isr_process_encoder1(void)
 {
-  if(digitalRead(Encoder_1.getPortB()) == 0){
-    Encoder_1.pulsePosMinus();
+  if(*encoder1Pins.portB & encoder1Pins.maskB){
+    encoder1Pulses++;
   }
   else{
-    Encoder_1.pulsePosPlus();
+    encoder1Pulses--;
   }
+  encoder1EdgeTicks = readControlTimerTicks();
 }
 void isr_process_encoder2(void)
 {
-  if(digitalRead(Encoder_2.getPortB()) == 0){
-    Encoder_2.pulsePosMinus();
+  if(*encoder2Pins.portB & encoder2Pins.maskB){
+    encoder2Pulses++;
   }else{
-    Encoder_2.pulsePosPlus();
+    encoder2Pulses--;
   }
+  encoder2EdgeTicks = readControlTimerTicks();
 }
 
+//Same as above for two and four times decoding, called on every edge of the channels that have an interrupt
+void isr_decode_encoder1(void)
+{
+  encoder1Pulses += decodeEncoderTransition(&encoder1Pins);
+  encoder1EdgeTicks = readControlTimerTicks();
+}
+void isr_decode_encoder2(void)
+{
+  encoder2Pulses += decodeEncoderTransition(&encoder2Pins);
+  encoder2EdgeTicks = readControlTimerTicks();
+}
 
 void printEncoderPulseValues(){
-  Serial.println("Encoder 1: ");
-  Serial.println(getEncoder1Pulses());
-  Serial.println("Encoder 2: ");
-  Serial.println(getEncoder2Pulses());
+  sendDebugLine("Encoder 1: %ld, encoder 2: %ld", (long)getEncoder1Pulses(), (long)getEncoder2Pulses());
 }
 
 long getEncoder1Pulses(){
-  return Encoder_1.getPulsePos();
+  long pulses;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    pulses = encoder1Pulses;
+  }
+  return pulses;
 }
 long getEncoder2Pulses(){
-  return Encoder_2.getPulsePos();
+  long pulses;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    pulses = encoder2Pulses;
+  }
+  return pulses;
 }
 
+//Both counts and the time are taken with interrupts off, so they all belong to the same instant
+void getEncoderSnapshot(encoderSnapshot_t *snapshot){
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    snapshot->encoder1Pulses = encoder1Pulses;
+    snapshot->encoder2Pulses = encoder2Pulses;
+    snapshot->timeMicros = micros();
+  }
+}
 
 void setEncoder1Pulse(long pos){
-  Encoder_1.setPulsePos(pos);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    encoder1Speed.previousPulses += pos - encoder1Pulses;
+    encoder1Pulses = pos;
+  }
 }
 void setEncoder2Pulse(long pos){
-  Encoder_2.setPulsePos(pos);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    encoder2Speed.previousPulses += pos - encoder2Pulses;
+    encoder2Pulses = pos;
+  }
 }
 
 
 void resetEncoderValues(){
-  Encoder_1.setPulsePos(0);
-  Encoder_2.setPulsePos(0);
+  setEncoder1Pulse(0);
+  setEncoder2Pulse(0);
   resetGyroStartAndEnd();
 }
 
 //When calculating distance travelled, it is better to calculate the average between the encoders to lower the error margin
-float getEncoderAverage(){
-  return (((-1* getEncoder1Pulses()) + getEncoder2Pulses() ) * 0.5); //*-1 since the first motor is inverted physically.
+//Each wheel has its own calibrated distance per count
+float getEncoderDistanceAverage(){
+  encoderSnapshot_t snapshot;
+  getEncoderSnapshot(&snapshot);
+  return (((-1* snapshot.encoder1Pulses * getEncoderMillimeterPerCount(1)) + snapshot.encoder2Pulses * getEncoderMillimeterPerCount(2)) * 0.5); //*-1 since the first motor is inverted physically.
 }
 
 void setEncoder1TarPWM(int16_t speedRightMotor){
-  Encoder_1.setTarPWM(speedRightMotor);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    Encoder_1.setTarPWM(speedRightMotor);
+  }
 }
 
 void setEncoder2TarPWM(int16_t speedLeftMotor){
-  Encoder_2.setTarPWM(speedLeftMotor);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    Encoder_2.setTarPWM(speedLeftMotor);
+  }
 }
 
+/*
+ * Runs the wheel control step, the speed measurement and either the speed controllers or the PWM ramping of the library,
+ * from the control timer interrupt or from the main loop.
+ * The pulse counts are kept in this file, so the encoder interrupts can stay on while it runs.
+ */
 void loopEncoders(){
-  encoder1Loop();
-  encoder2Loop();
+  PROFILE_START(PROFILE_ENCODERS);
+  updateWheelSpeeds();
+  if(isWheelSpeedControlActive()){
+    doWheelSpeedControlStep();
+  }
+  else{
+    encoder1Loop();
+    encoder2Loop();
+  }
+  PROFILE_END(PROFILE_ENCODERS);
+}
+
+/*
+ * The speed is the number of counts since the last update divided by the time between the last edge before and the
+ * last edge since the previous update. At high speed that is a count over about one update period, at low speed a
+ * single count over the time between two edges, so slow wheels get a speed from every edge instead of mostly zeros.
+ * Without a new edge the speed can at most be one count over the time since the last edge, which brings it down
+ * smoothly when the wheel stops. The first edge after standing still has no start time and only restarts the measuring.
+ */
+static void updateWheelSpeed(wheelSpeed_t *wheel, long pulses, uint16_t edgeTicks, uint16_t nowTicks, float millimeterPerCount){
+  long countedPulses = pulses - wheel->previousPulses;
+
+  if(countedPulses != 0){
+    uint32_t edgeTime = speedClockTicks - (uint16_t)(nowTicks - edgeTicks);
+    uint32_t ticksBetweenEdges = edgeTime - wheel->previousEdgeTime;
+    wheel->previousPulses = pulses;
+    wheel->previousEdgeTime = edgeTime;
+
+    if(wheel->standing || ticksBetweenEdges == 0 || ticksBetweenEdges > WHEEL_SPEED_TIMEOUT_TICKS){
+      wheel->standing = false;
+      wheel->speed = 0;
+      return;
+    }
+    wheel->speed = countedPulses * millimeterPerCount * CONTROL_TIMER_TICKS_PER_SECOND / ticksBetweenEdges;
+    return;
+  }
+
+  uint32_t ticksSinceEdge = speedClockTicks - wheel->previousEdgeTime;
+  if(ticksSinceEdge > WHEEL_SPEED_TIMEOUT_TICKS){
+    wheel->standing = true;
+    wheel->speed = 0;
+    return;
+  }
+  float maxSpeed = millimeterPerCount * CONTROL_TIMER_TICKS_PER_SECOND / ticksSinceEdge;
+  if(fabs(wheel->speed) > maxSpeed){
+    wheel->speed = wheel->speed > 0 ? maxSpeed : -maxSpeed;
+  }
+}
+
+//A gap longer than the timeout loses the edge times, the wheel counts as standing and the next edge restarts measuring
+static void restartWheelSpeed(wheelSpeed_t *wheel, long pulses){
+  wheel->previousPulses = pulses;
+  wheel->previousEdgeTime = speedClockTicks;
+  wheel->standing = true;
+  wheel->speed = 0;
+}
+
+//Called from the wheel control step, which runs far more often than the 16-bit timer wraps unless the main loop blocks
+void updateWheelSpeeds(){
+  long pulses1, pulses2;
+  uint16_t edgeTicks1, edgeTicks2, nowTicks;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    pulses1 = encoder1Pulses;
+    pulses2 = encoder2Pulses;
+    edgeTicks1 = encoder1EdgeTicks;
+    edgeTicks2 = encoder2EdgeTicks;
+    nowTicks = readControlTimerTicks();
+  }
+  unsigned long nowMillis = millis();
+  unsigned long millisSinceUpdate = nowMillis - speedClockLastMillis;
+  speedClockLastMillis = nowMillis;
+
+  if(millisSinceUpdate > WHEEL_SPEED_TIMEOUT_MS){
+    //The counter may have wrapped, advance the clock by millis() instead and drop the edges counted in the gap
+    speedClockTicks += millisSinceUpdate * 1000UL / CONTROL_TIMER_MICROS_PER_TICK;
+    speedClockLastTicks = nowTicks;
+    restartWheelSpeed(&encoder1Speed, pulses1);
+    restartWheelSpeed(&encoder2Speed, pulses2);
+    return;
+  }
+  speedClockTicks += (uint16_t)(nowTicks - speedClockLastTicks);
+  speedClockLastTicks = nowTicks;
+
+  updateWheelSpeed(&encoder1Speed, pulses1, edgeTicks1, nowTicks, encoder1MillimeterPerCount);
+  updateWheelSpeed(&encoder2Speed, pulses2, edgeTicks2, nowTicks, encoder2MillimeterPerCount);
+}
+
+float getEncoder1Speed(){
+  float speed;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    speed = encoder1Speed.speed;
+  }
+  return speed;
+}
+
+float getEncoder2Speed(){
+  float speed;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    speed = encoder2Speed.speed;
+  }
+  return speed;
+}
+
+//Only used by the speed control, which replaces the PWM ramping of the library
+void setEncoder1MotorPwm(int16_t pwm){
+  Encoder_1.setMotorPwm(pwm);
+}
+
+void setEncoder2MotorPwm(int16_t pwm){
+  Encoder_2.setMotorPwm(pwm);
 }
 
 void encoder1Loop(){
@@ -86,9 +392,17 @@ void encoder2Loop(){
 }
 
 int16_t getEncoder1CurPwm(){
-  return Encoder_1.getCurPwm();
+  int16_t pwm;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    pwm = Encoder_1.getCurPwm();
+  }
+  return pwm;
 }
 
 int16_t getEncoder2CurPwm(){
-  return Encoder_2.getCurPwm();
+  int16_t pwm;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    pwm = Encoder_2.getCurPwm();
+  }
+  return pwm;
 }
\ No newline at end of file
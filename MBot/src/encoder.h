@@ -5,10 +5,20 @@
 
 #include "MeEncoderOnBoard.h"
 #include "MePort.h"
+#include "fixed_point.h"
 
 #ifndef ENCODER_FUNCTIONS_H
 #define ENCODER_FUNCTIONS_H
 
+/**
+ * @brief Pulse counts of both encoders taken at the same instant.
+ */
+typedef struct {
+  long encoder1Pulses;      /**< Pulse count of encoder 1. */
+  long encoder2Pulses;      /**< Pulse count of encoder 2. */
+  unsigned long timeMicros; /**< Time the counts were read, from micros(). */
+} encoderSnapshot_t;
+
 /**
  * @brief Sets up interrupts for encoder pulses.
  */
@@ -24,6 +34,44 @@ void isr_process_encoder1();
  */
 void isr_process_encoder2();
 
+/**
+ * @brief Decodes a transition of encoder 1, used for two and four times decoding.
+ */
+void isr_decode_encoder1();
+
+/**
+ * @brief Decodes a transition of encoder 2, used for two and four times decoding.
+ */
+void isr_decode_encoder2();
+
+/**
+ * @brief Retrieves the number of counts per pulse of channel A in use, which can be lower than
+ * ENCODER_DECODING_MULTIPLIER when the encoder pins do not support it.
+ * @return 1, 2 or 4.
+ */
+uint8_t getEncoderDecodingMultiplier();
+
+/**
+ * @brief Sets the calibrated distance a wheel travels per pulse of channel A.
+ * @param encoderNumber The encoder of the wheel, 1 or 2.
+ * @param millimeterPerPulse Distance per pulse in millimeters.
+ */
+void setEncoderMillimeterPerPulse(uint8_t encoderNumber, float millimeterPerPulse);
+
+/**
+ * @brief Retrieves the distance a wheel travels per count, with the decoding multiplier in use.
+ * @param encoderNumber The encoder of the wheel, 1 or 2.
+ * @return Distance per count in millimeters.
+ */
+float getEncoderMillimeterPerCount(uint8_t encoderNumber);
+
+/**
+ * @brief Retrieves the distance a wheel travels per count in fixed point, for the odometry.
+ * @param encoderNumber The encoder of the wheel, 1 or 2.
+ * @return Distance per count in Q16.16 millimeters.
+ */
+fixed_t getEncoderMillimeterPerCountFixed(uint8_t encoderNumber);
+
 /**
  * @brief Prints the pulse values of both encoders.
  */
@@ -41,6 +89,12 @@ long getEncoder1Pulses();
  */
 long getEncoder2Pulses();
 
+/**
+ * @brief Reads the pulse counts of both encoders and the current time in a single critical section.
+ * @param snapshot Snapshot to fill in.
+ */
+void getEncoderSnapshot(encoderSnapshot_t *snapshot);
+
 /**
  * @brief Sets the pulse count of encoder 1 to a specified value.
  * @param pos The position to set for encoder 1.
@@ -59,10 +113,10 @@ void setEncoder2Pulse(long pos);
 void resetEncoderValues();
 
 /**
- * @brief Calculates the average pulse count between encoders.
- * @return The average pulse count between encoders.
+ * @brief Calculates the average distance travelled by both wheels.
+ * @return The average distance in millimeters, positive forward.
  */
-float getEncoderAverage();
+float getEncoderDistanceAverage();
 
 /**
  * @brief Sets the target PWM value for encoder 1.
@@ -76,6 +130,35 @@ void setEncoder1TarPWM(int16_t speedRightMotor);
  */
 void setEncoder2TarPWM(int16_t speedLeftMotor);
 
+/**
+ * @brief Updates the speed of both wheels from the encoder edge times, called at the start of every wheel control step.
+ */
+void updateWheelSpeeds();
+
+/**
+ * @brief Retrieves the speed of the wheel of encoder 1, with the same sign as its pulse count.
+ * @return Speed in millimeters per second.
+ */
+float getEncoder1Speed();
+
+/**
+ * @brief Retrieves the speed of the wheel of encoder 2, with the same sign as its pulse count.
+ * @return Speed in millimeters per second.
+ */
+float getEncoder2Speed();
+
+/**
+ * @brief Sets the PWM of the motor of encoder 1 directly, without the ramping of the library.
+ * @param pwm The PWM value, -255 to 255.
+ */
+void setEncoder1MotorPwm(int16_t pwm);
+
+/**
+ * @brief Sets the PWM of the motor of encoder 2 directly, without the ramping of the library.
+ * @param pwm The PWM value, -255 to 255.
+ */
+void setEncoder2MotorPwm(int16_t pwm);
+
 /**
  * @brief Runs the loop function for both encoders.
  */
@@ -0,0 +1,46 @@
+#include "fixed_point.h"
+
+/*
+ * Compile time series for the tables, only used in constant expressions. C++11 constexpr functions are a single return
+ * statement, so the series are written as recursions.
+ */
+constexpr double fixedConstSinSeries(double x, double term, int n){
+  return n > 23 ? term : term + fixedConstSinSeries(x, -term * x * x / ((n + 1) * (n + 2)), n + 2);
+}
+
+constexpr double fixedConstSin(double x){
+  return fixedConstSinSeries(x, x, 1);
+}
+
+constexpr double fixedConstSqrtNewton(double value, double guess, int iterations){
+  return iterations == 0 ? guess : fixedConstSqrtNewton(value, (guess + value / guess) * 0.5, iterations - 1);
+}
+
+constexpr double fixedConstAtanSeries(double x, double power, int n){
+  return n > 31 ? 0 : power / n - fixedConstAtanSeries(x, power * x * x, n + 2);
+}
+
+//atan(x) = 2 atan(x / (1 + sqrt(1 + x^2))) brings x from at most 1 to at most 0.42, where the series converges quickly
+constexpr double fixedConstAtan(double x){
+  return 2 * fixedConstAtanSeries(x / (1 + fixedConstSqrtNewton(1 + x * x, 1.2, 8)), x / (1 + fixedConstSqrtNewton(1 + x * x, 1.2, 8)), 1);
+}
+
+#define FIXED_SIN_ENTRY(i) (int16_t)(fixedConstSin((i) * (M_PI / 2 / FIXED_SIN_TABLE_SIZE)) * FIXED_Q15_ONE + 0.5)
+#define FIXED_SIN_ENTRIES_4(i) FIXED_SIN_ENTRY(i), FIXED_SIN_ENTRY((i) + 1), FIXED_SIN_ENTRY((i) + 2), FIXED_SIN_ENTRY((i) + 3)
+#define FIXED_SIN_ENTRIES_16(i) FIXED_SIN_ENTRIES_4(i), FIXED_SIN_ENTRIES_4((i) + 4), FIXED_SIN_ENTRIES_4((i) + 8), FIXED_SIN_ENTRIES_4((i) + 12)
+#define FIXED_SIN_ENTRIES_64(i) FIXED_SIN_ENTRIES_16(i), FIXED_SIN_ENTRIES_16((i) + 16), FIXED_SIN_ENTRIES_16((i) + 32), FIXED_SIN_ENTRIES_16((i) + 48)
+
+#define FIXED_ATAN_ENTRY(i) (uint16_t)(fixedConstAtan((double)(i) / FIXED_ATAN_TABLE_SIZE) * (32768.0 / M_PI) + 0.5)
+#define FIXED_ATAN_ENTRIES_4(i) FIXED_ATAN_ENTRY(i), FIXED_ATAN_ENTRY((i) + 1), FIXED_ATAN_ENTRY((i) + 2), FIXED_ATAN_ENTRY((i) + 3)
+#define FIXED_ATAN_ENTRIES_16(i) FIXED_ATAN_ENTRIES_4(i), FIXED_ATAN_ENTRIES_4((i) + 4), FIXED_ATAN_ENTRIES_4((i) + 8), FIXED_ATAN_ENTRIES_4((i) + 12)
+#define FIXED_ATAN_ENTRIES_64(i) FIXED_ATAN_ENTRIES_16(i), FIXED_ATAN_ENTRIES_16((i) + 16), FIXED_ATAN_ENTRIES_16((i) + 32), FIXED_ATAN_ENTRIES_16((i) + 48)
+
+const int16_t fixedSinTable[FIXED_SIN_TABLE_SIZE + 1] PROGMEM = {
+  FIXED_SIN_ENTRIES_64(0), FIXED_SIN_ENTRIES_64(64), FIXED_SIN_ENTRIES_64(128), FIXED_SIN_ENTRIES_64(192),
+  FIXED_SIN_ENTRY(FIXED_SIN_TABLE_SIZE)
+};
+
+const uint16_t fixedAtanTable[FIXED_ATAN_TABLE_SIZE + 1] PROGMEM = {
+  FIXED_ATAN_ENTRIES_64(0), FIXED_ATAN_ENTRIES_64(64), FIXED_ATAN_ENTRIES_64(128), FIXED_ATAN_ENTRIES_64(192),
+  FIXED_ATAN_ENTRY(FIXED_ATAN_TABLE_SIZE)
+};
@@ -0,0 +1,245 @@
+/**
+ * @file fixed_point.h
+ * @brief Header file containing fixed point arithmetic and trigonometry for the hot paths of the firmware.
+ */
+
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+/**
+ * @brief The ATmega2560 has no FPU, a soft float sin() or atan2() costs thousands of cycles. This module works on
+ * integers instead:
+ * - fixed_t is a Q16.16 number, used for millimeters in the odometry. Adding, subtracting and multiplying saturate at
+ *   the limits instead of wrapping around.
+ * - binaryAngle_t is an angle where the full circle is 65536, so angles wrap for free in 16 bits.
+ * - Sines and cosines are Q1.15 (32767 is 1.0), read from a quarter wave table in flash with linear interpolation.
+ * - atan2 returns a binary angle, read from an arctangent table over one octant.
+ *
+ * Both tables are computed by the compiler from constexpr series in fixed_point.cpp, nothing is computed on the robot
+ * and the tables cost 1 kB of flash. The functions are inline in this header. Send "bench" in standby for the cycle counts against soft float,
+ * see doFixedPointBenchmark() in testing_code.h.
+ */
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+
+/**
+ * @brief Q16.16 fixed point number.
+ */
+typedef int32_t fixed_t;
+
+/**
+ * @brief Angle where 65536 is a full circle, 16384 is 90 degrees.
+ */
+typedef uint16_t binaryAngle_t;
+
+#define FIXED_FRACTION_BITS 16
+#define FIXED_ONE ((fixed_t)1 << FIXED_FRACTION_BITS)
+#define FIXED_MAX INT32_MAX
+#define FIXED_MIN INT32_MIN
+#define FIXED_Q15_ONE 32767
+#define BINARY_ANGLE_PER_DEGREE (65536.0 / 360.0)
+
+#define FIXED_SIN_TABLE_SIZE 256 //entries per quarter circle, plus one for 90 degrees
+#define FIXED_ATAN_TABLE_SIZE 256 //entries from 0 to 45 degrees, plus one for 45 degrees
+
+//Defined once in fixed_point.cpp, computed there by the compiler
+extern const int16_t fixedSinTable[FIXED_SIN_TABLE_SIZE + 1] PROGMEM;
+extern const uint16_t fixedAtanTable[FIXED_ATAN_TABLE_SIZE + 1] PROGMEM;
+
+/**
+ * @brief Converts an integer to fixed point, saturating outside of +-32768.
+ * @param value The integer.
+ * @return The fixed point value.
+ */
+static inline fixed_t fixedFromInt(int32_t value){
+  if(value > (FIXED_MAX >> FIXED_FRACTION_BITS)){
+    return FIXED_MAX;
+  }
+  if(value < (FIXED_MIN >> FIXED_FRACTION_BITS)){
+    return FIXED_MIN;
+  }
+  return value * FIXED_ONE;
+}
+
+/**
+ * @brief Converts a float to fixed point, saturating outside of +-32768.
+ * @param value The float.
+ * @return The fixed point value.
+ */
+static inline fixed_t fixedFromFloat(float value){
+  float scaled = value * FIXED_ONE;
+  if(scaled >= 2147483647.0f){
+    return FIXED_MAX;
+  }
+  if(scaled <= -2147483648.0f){
+    return FIXED_MIN;
+  }
+  return (fixed_t)scaled;
+}
+
+/**
+ * @brief Converts fixed point to an integer, rounding to the nearest and saturating at INT16_MAX.
+ * @param value The fixed point value.
+ * @return The integer, -32768 to 32767.
+ */
+static inline int16_t fixedToInt(fixed_t value){
+  //Rounding up the values just below FIXED_MAX would give 32768
+  if(value >= FIXED_MAX - FIXED_ONE / 2){
+    return INT16_MAX;
+  }
+  return (value >> FIXED_FRACTION_BITS) + ((value >> (FIXED_FRACTION_BITS - 1)) & 1);
+}
+
+/**
+ * @brief Converts fixed point to a float.
+ * @param value The fixed point value.
+ * @return The float.
+ */
+static inline float fixedToFloat(fixed_t value){
+  return value * (1.0f / FIXED_ONE);
+}
+
+/**
+ * @brief Adds two fixed point numbers, saturating instead of wrapping around.
+ * @param a The first number.
+ * @param b The second number.
+ * @return The sum.
+ */
+static inline fixed_t fixedAdd(fixed_t a, fixed_t b){
+  fixed_t sum = (fixed_t)((uint32_t)a + (uint32_t)b);
+  //An overflow gives a sum with the opposite sign of two operands of equal sign
+  if(((a ^ sum) & (b ^ sum)) < 0){
+    return a < 0 ? FIXED_MIN : FIXED_MAX;
+  }
+  return sum;
+}
+
+/**
+ * @brief Subtracts two fixed point numbers, saturating instead of wrapping around.
+ * @param a The number to subtract from.
+ * @param b The number to subtract.
+ * @return The difference.
+ */
+static inline fixed_t fixedSub(fixed_t a, fixed_t b){
+  fixed_t difference = (fixed_t)((uint32_t)a - (uint32_t)b);
+  if(((a ^ b) & (a ^ difference)) < 0){
+    return a < 0 ? FIXED_MIN : FIXED_MAX;
+  }
+  return difference;
+}
+
+/**
+ * @brief Multiplies two fixed point numbers, saturating instead of wrapping around.
+ * @param a The first number.
+ * @param b The second number.
+ * @return The product.
+ */
+static inline fixed_t fixedMul(fixed_t a, fixed_t b){
+  int64_t product = ((int64_t)a * b) >> FIXED_FRACTION_BITS;
+  if(product > FIXED_MAX){
+    return FIXED_MAX;
+  }
+  if(product < FIXED_MIN){
+    return FIXED_MIN;
+  }
+  return (fixed_t)product;
+}
+
+/**
+ * @brief Multiplies a fixed point number by a Q1.15 factor such as a sine, without a 64 bit multiplication.
+ * The value is split at bit 15, both halves times a 16 bit factor fit in 32 bits, so this can not overflow.
+ * @param value The fixed point number.
+ * @param factor The factor, -32767 to 32767.
+ * @return The product, rounded towards minus infinity.
+ */
+static inline fixed_t fixedMulQ15(fixed_t value, int16_t factor){
+  int32_t high = value >> 15;
+  int32_t low = value & 0x7FFF;
+  return high * factor + ((low * factor) >> 15);
+}
+
+/**
+ * @brief Converts degrees to a binary angle, wrapping to the full circle.
+ * @param degrees The angle in degrees, any value.
+ * @return The binary angle.
+ */
+static inline binaryAngle_t fixedAngleFromDegrees(float degrees){
+  return (binaryAngle_t)(int32_t)(degrees * BINARY_ANGLE_PER_DEGREE);
+}
+
+/**
+ * @brief Calculates the sine of an angle from the table, interpolating between its entries.
+ * @param angle The angle.
+ * @return The sine in Q1.15.
+ */
+static inline int16_t fixedSin(binaryAngle_t angle){
+  //Quarter, index in the quarter and 6 bits between two entries
+  uint8_t quarter = angle >> 14;
+  uint16_t position = angle & 0x3FFF;
+  if(quarter & 1){
+    position = 0x4000 - position;
+  }
+  uint16_t index = position >> 6;
+  uint8_t fraction = position & 0x3F;
+  int16_t value = pgm_read_word(&fixedSinTable[index]);
+  if(fraction != 0){
+    int16_t next = pgm_read_word(&fixedSinTable[index + 1]);
+    value += ((int16_t)(next - value) * fraction) >> 6;
+  }
+  return quarter & 2 ? -value : value;
+}
+
+/**
+ * @brief Calculates the cosine of an angle from the sine table.
+ * @param angle The angle.
+ * @return The cosine in Q1.15.
+ */
+static inline int16_t fixedCos(binaryAngle_t angle){
+  return fixedSin(angle + 0x4000);
+}
+
+/**
+ * @brief Calculates the angle of a vector, like atan2(y, x).
+ * @param y The Y component, any scale.
+ * @param x The X component, the same scale as y.
+ * @return The binary angle of the vector, 0 along positive X and 16384 along positive Y. 0 for a zero vector.
+ */
+static inline binaryAngle_t fixedAtan2(int32_t y, int32_t x){
+  uint32_t absoluteX = x < 0 ? -(uint32_t)x : x;
+  uint32_t absoluteY = y < 0 ? -(uint32_t)y : y;
+  bool swapped = absoluteY > absoluteX;
+  uint32_t larger = swapped ? absoluteY : absoluteX;
+  uint32_t smaller = swapped ? absoluteX : absoluteY;
+  if(larger == 0){
+    return 0;
+  }
+
+  //Kept below 16 bits so the ratio is a 32 bit division
+  while(larger > 0xFFFF){
+    larger >>= 1;
+    smaller >>= 1;
+  }
+  uint32_t ratio = (smaller << 16) / larger; //0 to 65536 for 0 to 45 degrees
+  uint16_t index = ratio >> 8;
+  uint8_t fraction = ratio & 0xFF;
+  uint16_t angle = pgm_read_word(&fixedAtanTable[index]);
+  if(fraction != 0){
+    uint16_t next = pgm_read_word(&fixedAtanTable[index + 1]);
+    angle += ((uint32_t)(next - angle) * fraction) >> 8;
+  }
+
+  //Back from the first octant to the quadrant of the vector
+  if(swapped){
+    angle = 0x4000 - angle;
+  }
+  if(x < 0){
+    angle = 0x8000 - angle;
+  }
+  if(y < 0){
+    angle = -angle;
+  }
+  return angle;
+}
+
+#endif // FIXED_POINT_H
@@ -1,31 +1,169 @@
+#include <Wire.h>
+#include "config.h"
 #include "gyro.h"
-#include <HardwareSerial.h>
+#include "serial.h"
+#include "profiler.h"
+#include "encoder.h"
+
+//MPU6050 registers
+#define MPU6050_SMPLRT_DIV 0x19
+#define MPU6050_CONFIG 0x1A
+#define MPU6050_GYRO_CONFIG 0x1B
+#define MPU6050_ACCEL_CONFIG 0x1C
+#define MPU6050_FIFO_EN 0x23
+#define MPU6050_USER_CTRL 0x6A
+#define MPU6050_PWR_MGMT_1 0x6B
+#define MPU6050_FIFO_COUNTH 0x72
+#define MPU6050_FIFO_R_W 0x74
+
+#define MPU6050_FIFO_SIZE_BYTES 1024
+#define MPU6050_FIFO_ACCEL_AND_GYRO 0x78 //XG, YG, ZG and ACCEL, 12 bytes per sample in that register order
+#define MPU6050_USER_CTRL_FIFO_EN 0x40
+#define MPU6050_USER_CTRL_FIFO_RESET 0x04
+#define MPU6050_GYRO_FULL_SCALE_500_DPS 0x08
+#define MPU6050_DLPF_188_HZ 0x01 //sets the gyro output rate to 1 kHz
+#define MPU6050_CLOCK_PLL_GYRO_X 0x01 //more stable than the internal oscillator, so the sample period is kept
+
+#define GYRO_SAMPLE_BYTES 12
+#define GYRO_LSB_PER_DEGREE_PER_SECOND 65.5 //at +-500 degrees per second
+#define GYRO_SAMPLE_PERIOD_S (1.0 / GYRO_SAMPLE_RATE_HZ)
+
+typedef struct {
+  int16_t accelerometer[3];
+  int16_t rate[3];
+} gyroSample_t;
+
+float gyroAngleX = 0;
+float gyroAngleY = 0;
+float gyroAngleZ = 0;
+long gyroFullTurns = 0; //Times the Z angle wrapped, the heading is kept as these and the wrapped angle so it keeps its resolution
+float gyroRateOffset[3] = {0, 0, 0};
+float gyroYawRate = 0;
+uint16_t gyroFifoOverflows = 0;
+
+//Encoder counts when the wheels were last seen moving
+encoderSnapshot_t gyroLastMovement;
+bool gyroStationary = false;
 
-MeGyro gyro(9, 0x69); //RNR10
 float gyroValueAtStart = 0;
 float gyroValueAtEnd = 0;
 
+static void writeGyroRegister(uint8_t reg, uint8_t value){
+  Wire.beginTransmission(GYRO_I2C_ADDRESS);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+}
+
+//Reading FIFO_R_W repeatedly gives the next bytes of the FIFO, so a burst reads whole samples in one transaction
+static uint8_t readGyroRegisters(uint8_t reg, uint8_t *data, uint8_t length){
+  Wire.beginTransmission(GYRO_I2C_ADDRESS);
+  Wire.write(reg);
+  if(Wire.endTransmission(false) != 0){
+    return 0;
+  }
+  uint8_t received = Wire.requestFrom((uint8_t)GYRO_I2C_ADDRESS, length);
+  for(uint8_t i = 0; i < received; i++){
+    data[i] = Wire.read();
+  }
+  return received;
+}
+
+static void resetGyroFifo(){
+  writeGyroRegister(MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_RESET);
+  writeGyroRegister(MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN);
+}
+
+/*
+ * Reads up to maxSamples samples from the FIFO. A full FIFO has dropped bytes at the front and a failed read may have
+ * taken part of a sample, both lose track of where the samples start, so the FIFO is reset and starts over.
+ */
+static uint8_t readGyroFifo(gyroSample_t *samples, uint8_t maxSamples){
+  uint8_t data[GYRO_FIFO_BURST_SAMPLES * GYRO_SAMPLE_BYTES];
+  if(readGyroRegisters(MPU6050_FIFO_COUNTH, data, 2) != 2){
+    return 0;
+  }
+  uint16_t fifoBytes = ((uint16_t)data[0] << 8) | data[1];
+  if(fifoBytes > MPU6050_FIFO_SIZE_BYTES - GYRO_SAMPLE_BYTES){
+    resetGyroFifo();
+    gyroFifoOverflows++;
+    return 0;
+  }
+
+  uint8_t available = min(fifoBytes / GYRO_SAMPLE_BYTES, (uint16_t)maxSamples);
+  uint8_t samplesRead = 0;
+  while(samplesRead < available){
+    uint8_t burst = min(available - samplesRead, GYRO_FIFO_BURST_SAMPLES);
+    uint8_t burstBytes = burst * GYRO_SAMPLE_BYTES;
+    if(readGyroRegisters(MPU6050_FIFO_R_W, data, burstBytes) != burstBytes){
+      resetGyroFifo();
+      break;
+    }
+    for(uint8_t i = 0; i < burst; i++){
+      const uint8_t *sampleData = &data[i * GYRO_SAMPLE_BYTES];
+      for(uint8_t axis = 0; axis < 3; axis++){
+        samples[samplesRead].accelerometer[axis] = ((int16_t)sampleData[2 * axis] << 8) | sampleData[2 * axis + 1];
+        samples[samplesRead].rate[axis] = ((int16_t)sampleData[6 + 2 * axis] << 8) | sampleData[7 + 2 * axis];
+      }
+      samplesRead++;
+    }
+  }
+  return samplesRead;
+}
+
+//The robot stands still during setup, a missing sensor gives up after twice the expected time
+static void measureGyroRateOffsets(){
+  long sums[3] = {0, 0, 0};
+  uint16_t samplesSummed = 0;
+  gyroSample_t samples[GYRO_MAX_SAMPLES_PER_UPDATE];
+  unsigned long timeout = millis() + 2000UL * GYRO_BIAS_SAMPLES / GYRO_SAMPLE_RATE_HZ;
+
+  resetGyroFifo();
+  while(samplesSummed < GYRO_BIAS_SAMPLES && (long)(millis() - timeout) < 0){
+    uint8_t samplesRead = readGyroFifo(samples, min(GYRO_BIAS_SAMPLES - samplesSummed, GYRO_MAX_SAMPLES_PER_UPDATE));
+    for(uint8_t i = 0; i < samplesRead; i++){
+      for(uint8_t axis = 0; axis < 3; axis++){
+        sums[axis] += samples[i].rate[axis];
+      }
+    }
+    samplesSummed += samplesRead;
+  }
+  getEncoderSnapshot(&gyroLastMovement);
+  if(samplesSummed > 0){
+    for(uint8_t axis = 0; axis < 3; axis++){
+      gyroRateOffset[axis] = (float)sums[axis] / samplesSummed;
+    }
+  }
+}
+
 void setupGyro(){
-  gyro.begin();
+  Wire.begin();
+  Wire.setClock(GYRO_I2C_CLOCK_HZ);
+  writeGyroRegister(MPU6050_PWR_MGMT_1, MPU6050_CLOCK_PLL_GYRO_X);
+  writeGyroRegister(MPU6050_CONFIG, MPU6050_DLPF_188_HZ);
+  writeGyroRegister(MPU6050_SMPLRT_DIV, 1000 / GYRO_SAMPLE_RATE_HZ - 1);
+  writeGyroRegister(MPU6050_GYRO_CONFIG, MPU6050_GYRO_FULL_SCALE_500_DPS);
+  writeGyroRegister(MPU6050_ACCEL_CONFIG, 0x00);
+  writeGyroRegister(MPU6050_FIFO_EN, MPU6050_FIFO_ACCEL_AND_GYRO);
+  measureGyroRateOffsets();
 }
 
 float getGyroX(){
-  return gyro.getAngle(1);
+  return gyroAngleX;
 }
 
 float getGyroY(){
-  return gyro.getAngle(2);
+  return gyroAngleY;
 }
 
 float getGyroZ(){
-  return gyro.getAngle(3);
+  return gyroAngleZ;
 }
 
 
 void gyroPrintValues(){
-  Serial.println("Gyro X: " + String(getGyroX()));
-  Serial.println("Gyro Y: " + String(getGyroY()));
-  Serial.println("Gyro Z: " + String(getGyroZ()) + "\n");
+  //printf on the AVR has no floats, the angles are sent in centidegrees
+  sendDebugLine("Gyro X: %d, Y: %d, Z: %d", (int)(getGyroX() * 100), (int)(getGyroY() * 100), (int)(getGyroZ() * 100));
 }
 
 
@@ -63,6 +201,104 @@ float getAverageGyroValue(){
   return ((getGyroValueAtStart() + getGyroValueAtEnd()) * 0.5);
 }
 
+float getGyroHeading(){
+  return gyroFullTurns * 360.0 + gyroAngleZ;
+}
+
+binaryAngle_t getGyroBinaryHeading(){
+  return fixedAngleFromDegrees(gyroAngleZ);
+}
+
+float getGyroYawRate(){
+  return gyroYawRate;
+}
+
+float getGyroYawRateBias(){
+  return gyroRateOffset[2] / GYRO_LSB_PER_DEGREE_PER_SECOND;
+}
+
+bool isGyroStationary(){
+  return gyroStationary;
+}
+
+uint16_t getGyroFifoOverflows(){
+  return gyroFifoOverflows;
+}
+
+//Same axes and signs as MeGyro, the X and Y rates swap roles when the board is upside down
+static void integrateGyroSample(const gyroSample_t *sample){
+  const float degreesPerLsb = GYRO_SAMPLE_PERIOD_S / GYRO_LSB_PER_DEGREE_PER_SECOND;
+  float rateX = (sample->rate[0] - gyroRateOffset[0]) * degreesPerLsb;
+  float rateY = (sample->rate[1] - gyroRateOffset[1]) * degreesPerLsb;
+  if(sample->accelerometer[2] > 0){
+    gyroAngleX -= rateY;
+    gyroAngleY += rateX;
+  }
+  else{
+    gyroAngleX += rateY;
+    gyroAngleY -= rateX;
+  }
+
+  gyroYawRate = (sample->rate[2] - gyroRateOffset[2]) / GYRO_LSB_PER_DEGREE_PER_SECOND;
+  gyroAngleZ += gyroYawRate * GYRO_SAMPLE_PERIOD_S;
+  if(gyroAngleZ > 180){
+    gyroAngleZ -= 360;
+    gyroFullTurns++;
+  }
+  else if(gyroAngleZ <= -180){
+    gyroAngleZ += 360;
+    gyroFullTurns--;
+  }
+}
+
+//A wheel counts as moving when it leaves the jitter window around the counts it was last seen moving at
+static void updateGyroStationary(){
+  encoderSnapshot_t snapshot;
+  getEncoderSnapshot(&snapshot);
+  if(labs(snapshot.encoder1Pulses - gyroLastMovement.encoder1Pulses) > GYRO_STATIONARY_MAX_PULSES
+     || labs(snapshot.encoder2Pulses - gyroLastMovement.encoder2Pulses) > GYRO_STATIONARY_MAX_PULSES){
+    gyroLastMovement = snapshot;
+  }
+  gyroStationary = snapshot.timeMicros - gyroLastMovement.timeMicros >= GYRO_STATIONARY_MS * 1000UL;
+}
+
+/*
+ * Only called while the wheels stand. A robot that is turned by hand or lifted shows a real rate on a standing wheel,
+ * such samples are left out so they are not taken for drift.
+ */
+static void trackGyroRateOffsets(const gyroSample_t *sample){
+  if(fabs(gyroYawRate) > GYRO_STATIONARY_MAX_RATE_DPS){
+    return;
+  }
+  for(uint8_t axis = 0; axis < 3; axis++){
+    gyroRateOffset[axis] += GYRO_BIAS_TRACKING_WEIGHT * (sample->rate[axis] - gyroRateOffset[axis]);
+  }
+}
+
+//The tilt from the accelerometer only corrects the X and Y angles once per update, which keeps atan2 out of every sample
+static void correctGyroTilt(const gyroSample_t *sample){
+  float accelerometerX = sample->accelerometer[0];
+  float accelerometerY = sample->accelerometer[1];
+  float accelerometerZ = sample->accelerometer[2];
+  float tiltX = atan2(accelerometerX, sqrt(accelerometerY * accelerometerY + accelerometerZ * accelerometerZ)) * 180 / M_PI;
+  float tiltY = atan2(accelerometerY, sqrt(accelerometerX * accelerometerX + accelerometerZ * accelerometerZ)) * 180 / M_PI;
+  gyroAngleX += GYRO_TILT_ACCELEROMETER_WEIGHT * (tiltX - gyroAngleX);
+  gyroAngleY += GYRO_TILT_ACCELEROMETER_WEIGHT * (tiltY - gyroAngleY);
+}
+
 void updateGyro(){
-  gyro.update();
+  PROFILE_START(PROFILE_GYRO);
+  gyroSample_t samples[GYRO_MAX_SAMPLES_PER_UPDATE];
+  uint8_t samplesRead = readGyroFifo(samples, GYRO_MAX_SAMPLES_PER_UPDATE);
+  updateGyroStationary();
+  for(uint8_t i = 0; i < samplesRead; i++){
+    integrateGyroSample(&samples[i]);
+    if(gyroStationary){
+      trackGyroRateOffsets(&samples[i]);
+    }
+  }
+  if(samplesRead > 0){
+    correctGyroTilt(&samples[samplesRead - 1]);
+  }
+  PROFILE_END(PROFILE_GYRO);
 }
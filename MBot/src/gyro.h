@@ -3,13 +3,28 @@
  * @brief Header file defining functions related to gyroscopic sensor management.
  */
 
-#include "MeGyro.h"
+#include <Arduino.h>
+#include "fixed_point.h"
 
 #ifndef GYRO_FUNCTIONS_H
 #define GYRO_FUNCTIONS_H
 
 /**
- * @brief Sets up the gyro sensor.
+ * @brief This module reads the MPU6050 of the Auriga without the MeGyro library. The sensor samples at
+ * GYRO_SAMPLE_RATE_HZ into its own FIFO, which updateGyro() drains in short bursts at 400 kHz. Every sample is
+ * integrated over the sample period of the sensor, so the angles do not depend on when the loop gets to the update and
+ * nothing is lost while the loop is blocked for less than the FIFO holds.
+ *
+ * The Z angle follows the MeGyro convention: positive for right turns and wrapping at +-180 degrees. The same angle is
+ * also kept without wrapping as the heading.
+ *
+ * The zero rate offsets are measured at startup and then follow the drift of the sensor: whenever the encoders show
+ * both wheels standing still for GYRO_STATIONARY_MS, every sample moves the offsets a little towards the rates it
+ * measured. The angles and rates always have the current offsets removed.
+ */
+
+/**
+ * @brief Sets up the gyro sensor and measures its zero rate offsets, the robot must stand still.
  */
 void setupGyro();
 
@@ -82,7 +97,45 @@ float getGyroValueAtEnd();
 float getAverageGyroValue();
 
 /**
- * @brief Updates the gyro sensor values.
+ * @brief Retrieves the heading without wrapping, so turning a full circle right adds 360 degrees. Rotations are simple
+ * comparisons against a target heading.
+ * @return The heading in degrees since startup, positive for right turns.
+ */
+float getGyroHeading();
+
+/**
+ * @brief Retrieves the heading as a binary angle, which wraps every full turn like the angle itself.
+ * @return The heading, 16384 is 90 degrees to the right.
+ */
+binaryAngle_t getGyroBinaryHeading();
+
+/**
+ * @brief Retrieves the yaw rate of the last sample with the zero rate offset removed.
+ * @return The yaw rate in degrees per second, positive for right turns.
+ */
+float getGyroYawRate();
+
+/**
+ * @brief Retrieves the current estimate of the zero rate offset of the Z axis.
+ * @return The offset in degrees per second.
+ */
+float getGyroYawRateBias();
+
+/**
+ * @brief Checks if the encoders have shown the robot standing still for GYRO_STATIONARY_MS, while the zero rate
+ * offsets are tracked.
+ * @return True if the robot stands still.
+ */
+bool isGyroStationary();
+
+/**
+ * @brief Retrieves the number of times the FIFO of the sensor overflowed and was reset, losing the samples in it.
+ * @return The number of overflows since startup.
+ */
+uint16_t getGyroFifoOverflows();
+
+/**
+ * @brief Integrates the samples waiting in the FIFO of the sensor, at most GYRO_MAX_SAMPLES_PER_UPDATE of them.
  */
 void updateGyro();
 
@@ -1,90 +1,297 @@
+#include <avr/pgmspace.h>
 #include "localization.h"
 #include "led.h"
 #include "current_state.h"
+#include "motorcontrol.h"
+#include "config.h"
+#include "profiler.h"
 
-MeRGBLed rgbled_0(0, 12);
-float standby_brightness = 0.0;
-bool standby_brightness_increase = true;
+MeRGBLed rgbled_0(0, LED_COUNT);
+
+//Colors currently wanted on the LEDs, the layers are drawn over it bottom to top on every frame
+uint8_t ledFramebuffer[LED_COUNT][3];
+//Colors last sent to the LEDs, showLEDs() only sends the framebuffer when it differs from this
+uint8_t ledShownFrame[LED_COUNT][3];
+bool ledShownFrameValid = false;
+unsigned long timeAtLastLEDShow = 0;
+
+/*
+ * Effects are keyframe tables in flash, the color between two keyframes is interpolated linearly from the time since the
+ * effect started. Looping effects start over after their last keyframe, other effects end there.
+ * Keyframe colors are perceived brightness, they are gamma corrected when drawn (167 is about the old raw value 100).
+ */
+typedef struct {
+  uint16_t timeMs;
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+} ledKeyframe_t;
+
+typedef struct {
+  const ledKeyframe_t *keyframes;
+  uint8_t numberOfKeyframes;
+  uint16_t ledMask; /**< Bit 0 is LED 1 */
+  bool loops;
+} ledEffect_t;
+
+const ledKeyframe_t standbyBreatheKeyframes[] PROGMEM = {{0, 0, 0, 0}, {1100, 0, 0, 167}, {2200, 0, 0, 0}};
+const ledKeyframe_t manualKeyframes[] PROGMEM = {{0, 167, 167, 0}};
+const ledKeyframe_t arrowKeyframes[] PROGMEM = {{0, 167, 0, 0}};
+const ledKeyframe_t flashKeyframes[] PROGMEM = {{0, 167, 167, 167}, {100, 167, 167, 167}};
+
+#define ALL_LEDS 0x0FFF
+#define NUMBER_OF_KEYFRAMES(keyframes) (sizeof(keyframes) / sizeof(ledKeyframe_t))
+
+//Same order as ledEffectName_t
+const ledEffect_t ledEffects[] PROGMEM = {
+  {standbyBreatheKeyframes, NUMBER_OF_KEYFRAMES(standbyBreatheKeyframes), ALL_LEDS, true},
+  {manualKeyframes, NUMBER_OF_KEYFRAMES(manualKeyframes), ALL_LEDS, true},
+  {arrowKeyframes, NUMBER_OF_KEYFRAMES(arrowKeyframes), _BV(1) | _BV(2) | _BV(3), true}, //LED 2, 3, 4
+  {arrowKeyframes, NUMBER_OF_KEYFRAMES(arrowKeyframes), _BV(7) | _BV(8) | _BV(9), true}, //LED 8, 9, 10
+  {arrowKeyframes, NUMBER_OF_KEYFRAMES(arrowKeyframes), _BV(10) | _BV(11) | _BV(0), true}, //LED 11, 12, 1
+  {arrowKeyframes, NUMBER_OF_KEYFRAMES(arrowKeyframes), _BV(4) | _BV(5) | _BV(6), true}, //LED 5, 6, 7
+  {flashKeyframes, NUMBER_OF_KEYFRAMES(flashKeyframes), ALL_LEDS, false},
+};
+
+static_assert(sizeof(ledEffects) / sizeof(ledEffect_t) == NUMBER_OF_LED_EFFECTS, "ledEffects must list every ledEffectName_t");
+
+//Gamma 2.2, round(255 * (i / 255)^2.2)
+const uint8_t gammaTable[256] PROGMEM = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2,
+  3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6,
+  6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10, 11, 11, 11, 12,
+  12, 13, 13, 13, 14, 14, 15, 15, 16, 16, 17, 17, 18, 18, 19, 19,
+  20, 20, 21, 22, 22, 23, 23, 24, 25, 25, 26, 26, 27, 28, 28, 29,
+  30, 30, 31, 32, 33, 33, 34, 35, 35, 36, 37, 38, 39, 39, 40, 41,
+  42, 43, 43, 44, 45, 46, 47, 48, 49, 49, 50, 51, 52, 53, 54, 55,
+  56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+  73, 74, 75, 76, 77, 78, 79, 81, 82, 83, 84, 85, 87, 88, 89, 90,
+  91, 93, 94, 95, 97, 98, 99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+  113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+  137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+  163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+  192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+  223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255
+};
+
+//Effect playing on each layer, NUMBER_OF_LED_EFFECTS when the layer is off. Higher layers are drawn on top.
+uint8_t layerEffect[NUMBER_OF_LED_LAYERS] = {NUMBER_OF_LED_EFFECTS, NUMBER_OF_LED_EFFECTS, NUMBER_OF_LED_EFFECTS};
+unsigned long layerStartTime[NUMBER_OF_LED_LAYERS];
 
 void setupLED(){
   rgbled_0.setpin(44);
 }
 
+//Same numbering as the library: 0 sets every LED, 1 to LED_COUNT a single one
+bool setLEDColor(uint8_t index, uint8_t r, uint8_t g, uint8_t b){
+  if(index > LED_COUNT){
+    return false;
+  }
+
+  uint8_t first = index == 0 ? 0 : index - 1;
+  uint8_t last = index == 0 ? LED_COUNT - 1 : index - 1;
+  for(uint8_t i = first; i <= last; i++){
+    ledFramebuffer[i][0] = r;
+    ledFramebuffer[i][1] = g;
+    ledFramebuffer[i][2] = b;
+  }
+  return true;
+}
+
+//A new effect starts from its first keyframe, playing the same looping effect again keeps its phase
+void playLEDEffect(ledLayer_t layer, ledEffectName_t effect){
+  bool loops = pgm_read_byte(&ledEffects[effect].loops);
+  if(layerEffect[layer] == effect && loops){
+    return;
+  }
+  layerEffect[layer] = effect;
+  layerStartTime[layer] = millis();
+}
+
+void stopLEDEffect(ledLayer_t layer){
+  layerEffect[layer] = NUMBER_OF_LED_EFFECTS;
+}
+
+uint8_t interpolateColor(uint8_t from, uint8_t to, uint16_t elapsedMs, uint16_t durationMs){
+  int16_t difference = (int16_t)to - from;
+  return from + (int32_t)difference * elapsedMs / durationMs;
+}
+
+//Draws the effect of a layer into the framebuffer, returns false when a non-looping effect has ended
+bool drawLEDLayer(ledLayer_t layer, unsigned long now){
+  ledEffect_t effect;
+  memcpy_P(&effect, &ledEffects[layerEffect[layer]], sizeof(ledEffect_t));
+
+  ledKeyframe_t keyframe;
+  ledKeyframe_t nextKeyframe;
+  memcpy_P(&nextKeyframe, &effect.keyframes[effect.numberOfKeyframes - 1], sizeof(ledKeyframe_t));
+  uint16_t durationMs = nextKeyframe.timeMs;
+
+  unsigned long elapsedMs = now - layerStartTime[layer];
+  if(elapsedMs >= durationMs){
+    if(!effect.loops){
+      return false;
+    }
+    elapsedMs = durationMs > 0 ? elapsedMs % durationMs : 0;
+  }
+
+  //Find the keyframes around the elapsed time, a single keyframe is a constant color
+  uint8_t k = 0;
+  memcpy_P(&keyframe, &effect.keyframes[0], sizeof(ledKeyframe_t));
+  nextKeyframe = keyframe;
+  while(k + 1 < effect.numberOfKeyframes){
+    memcpy_P(&nextKeyframe, &effect.keyframes[k + 1], sizeof(ledKeyframe_t));
+    if(elapsedMs < nextKeyframe.timeMs){
+      break;
+    }
+    keyframe = nextKeyframe;
+    k++;
+  }
+
+  uint8_t r = keyframe.r;
+  uint8_t g = keyframe.g;
+  uint8_t b = keyframe.b;
+  if(nextKeyframe.timeMs > keyframe.timeMs){
+    uint16_t sinceKeyframe = elapsedMs - keyframe.timeMs;
+    uint16_t keyframeLength = nextKeyframe.timeMs - keyframe.timeMs;
+    r = interpolateColor(keyframe.r, nextKeyframe.r, sinceKeyframe, keyframeLength);
+    g = interpolateColor(keyframe.g, nextKeyframe.g, sinceKeyframe, keyframeLength);
+    b = interpolateColor(keyframe.b, nextKeyframe.b, sinceKeyframe, keyframeLength);
+  }
+
+  r = pgm_read_byte(&gammaTable[r]);
+  g = pgm_read_byte(&gammaTable[g]);
+  b = pgm_read_byte(&gammaTable[b]);
+  for(uint8_t i = 0; i < LED_COUNT; i++){
+    if(effect.ledMask & _BV(i)){
+      setLEDColor(i + 1, r, g, b);
+    }
+  }
+  return true;
+}
+
+void drawLEDEffects(){
+  unsigned long now = millis();
+  for(uint8_t layer = 0; layer < NUMBER_OF_LED_LAYERS; layer++){
+    if(layerEffect[layer] == NUMBER_OF_LED_EFFECTS){
+      continue;
+    }
+    if(!drawLEDLayer((ledLayer_t)layer, now)){
+      stopLEDEffect((ledLayer_t)layer);
+    }
+  }
+}
+
+/*
+ * Draws the effects and sends the frame, which bit-bangs all LEDs with interrupts off.
+ * This is only done when a pixel changed and at most LED_MAX_FRAME_RATE_HZ times per second, a call in between does nothing.
+ * Layers overlap (the direction arrow is drawn over the state color), so a pixel is only changed when the composed frame
+ * differs from the one last sent, not whenever a layer writes to it.
+ */
+void showLEDs(){
+  if(millis() - timeAtLastLEDShow < 1000 / LED_MAX_FRAME_RATE_HZ){
+    return;
+  }
+  timeAtLastLEDShow = millis();
+  drawLEDEffects();
+  if(!ledShownFrameValid || memcmp(ledFramebuffer, ledShownFrame, sizeof(ledFramebuffer)) != 0){
+    showLEDsNow();
+  }
+}
+
+void showLEDsNow(){
+  PROFILE_START(PROFILE_LED_SHOW);
+  for(uint8_t i = 0; i < LED_COUNT; i++){
+    rgbled_0.setColor(i + 1, ledFramebuffer[i][0], ledFramebuffer[i][1], ledFramebuffer[i][2]);
+  }
+  rgbled_0.show();
+  memcpy(ledShownFrame, ledFramebuffer, sizeof(ledFramebuffer));
+  ledShownFrameValid = true;
+  timeAtLastLEDShow = millis();
+  PROFILE_END(PROFILE_LED_SHOW);
+}
+
 void resetStateLEDs(){
   switch(getCurrentState()){
     case(STANDBY):
       activateStandbyLEDs();
       break;
     case(MANUAL):
+    case(AUTOTUNE):
+    case(CALIBRATION):
+    case(PWM_SWEEP):
       activateManualLEDs();
       break;
   }
 }
 
-void deactivateLEDs(){
-  rgbled_0.setColor(0, 0, 0, 0);
-  rgbled_0.show();
+//Run by the scheduler, shows the state and in manual mode an arrow in the direction of movement
+void doLEDTick(){
+  resetStateLEDs();
+  if(getCurrentState() == MANUAL){
+    activateManualDirectionLEDs();
+  }
+  else{
+    stopLEDEffect(LED_LAYER_DIRECTION);
+  }
+  showLEDs();
 }
 
-void activateAllLEDsRGB(int r, int g, int b, unsigned long delayTime = 100){
-  rgbled_0.setColor(0, r, g, b);
-  rgbled_0.show();
-  delay(delayTime);
+void activateManualDirectionLEDs(){
+  switch(getCurrentDirection()){
+    case(FORWARD):
+      activateManualForwardLEDs();
+      break;
+    case(BACKWARD):
+      activateManualBackwardLEDs();
+      break;
+    case(LEFT):
+      activateManualLeftLEDs();
+      break;
+    case(RIGHT):
+      activateManualRightLEDs();
+      break;
+    case(NONE):
+      stopLEDEffect(LED_LAYER_DIRECTION);
+      break;
+  }
 }
 
-void activateStandbyLEDs() {
-  if (getCurrentState() == STANDBY) {
-    if (standby_brightness_increase && standby_brightness < 100.0) {
-      standby_brightness += 0.1;
-    } else if (!standby_brightness_increase && standby_brightness > 0.0) {
-      standby_brightness -= 0.1;
-    }
-
-    // Toggle direction if brightness reaches limits
-    if (standby_brightness >= 100.0) {
-      standby_brightness_increase = false;
-    } else if (standby_brightness <= 0.0) {
-      standby_brightness_increase = true;
-    }
+void deactivateLEDs(){
+  for(uint8_t layer = 0; layer < NUMBER_OF_LED_LAYERS; layer++){
+    stopLEDEffect((ledLayer_t)layer);
+  }
+  setLEDColor(0, 0, 0, 0);
+  showLEDs();
+}
 
-    int brightnessInt = int(standby_brightness); // Adjust the scaling factor as needed
+void activateFlashLEDs(){
+  playLEDEffect(LED_LAYER_OVERLAY, LED_EFFECT_FLASH);
+}
 
-    rgbled_0.setColor(0, 0, 0, brightnessInt);
-    rgbled_0.show();
-  }
+void activateStandbyLEDs(){
+  playLEDEffect(LED_LAYER_STATE, LED_EFFECT_STANDBY_BREATHE);
 }
 
 void activateManualLEDs(){
-  rgbled_0.setColor(0, 100, 100, 0);
-  rgbled_0.show();
+  playLEDEffect(LED_LAYER_STATE, LED_EFFECT_MANUAL);
 }
 
 void activateManualForwardLEDs(){
-  rgbled_0.setColor(2, 100, 0, 0);
-  rgbled_0.setColor(3, 100, 0, 0);
-  rgbled_0.setColor(4, 100, 0, 0);
-  rgbled_0.show();
+  playLEDEffect(LED_LAYER_DIRECTION, LED_EFFECT_ARROW_FORWARD);
 }
 
 void activateManualBackwardLEDs(){
-  rgbled_0.setColor(8, 100, 0, 0);
-  rgbled_0.setColor(9, 100, 0, 0);
-  rgbled_0.setColor(10, 100, 0, 0);
-  rgbled_0.show();
+  playLEDEffect(LED_LAYER_DIRECTION, LED_EFFECT_ARROW_BACKWARD);
 }
 
 void activateManualRightLEDs(){
-  rgbled_0.setColor(5, 100, 0, 0);
-  rgbled_0.setColor(6, 100, 0, 0);
-  rgbled_0.setColor(7, 100, 0, 0);
-  rgbled_0.show();
+  playLEDEffect(LED_LAYER_DIRECTION, LED_EFFECT_ARROW_RIGHT);
 }
 
 void activateManualLeftLEDs(){
-  rgbled_0.setColor(11, 100, 0, 0);
-  rgbled_0.setColor(12, 100, 0, 0);
-  rgbled_0.setColor(1, 100, 0, 0);
-  rgbled_0.show();
+  playLEDEffect(LED_LAYER_DIRECTION, LED_EFFECT_ARROW_LEFT);
 }
 
 
@@ -99,9 +306,9 @@ void activateManualLeftLEDs(){
 int deactivateLEDsTest(){
   int errorCounter = 0;
 
-  if(!rgbled_0.setColor(0, 0, 0, 0)){errorCounter ++;}
+  if(!setLEDColor(0, 0, 0, 0)){errorCounter ++;}
   
-  rgbled_0.show();
+  showLEDsNow();
 
   return errorCounter;
 }
@@ -109,9 +316,9 @@ int deactivateLEDsTest(){
 int activateStandbyLEDsTest(){
   int errorCounter = 0;
   
-  if(!rgbled_0.setColor(0, 0, 0, 100)){errorCounter ++;}
+  if(!setLEDColor(0, 0, 0, 100)){errorCounter ++;}
   
-  rgbled_0.show();
+  showLEDsNow();
 
   return errorCounter;
 }
@@ -11,31 +11,97 @@
 /**
  * @brief This module contains various LED functions for indicating robot states (STANDBY or MANUAL).
  * LEDs are located on top of the Arduino board.
+ * The activate functions start an effect on a layer and return at once, nothing in this module waits.
+ * Effects are keyframe tables evaluated against millis() by showLEDs(), which draws the layers into a framebuffer
+ * and sends it to the LEDs when it differs from the frame last sent.
  */
 
+/**
+ * @brief Enum defining the effect layers, a higher layer is drawn on top of the lower ones.
+ */
+typedef enum {
+  LED_LAYER_STATE, /**< Robot state, covers all LEDs */
+  LED_LAYER_DIRECTION, /**< Arrow in the direction of movement */
+  LED_LAYER_OVERLAY, /**< Short indications such as the flash when a command is received */
+  NUMBER_OF_LED_LAYERS
+} ledLayer_t;
+
+/**
+ * @brief Enum defining the LED effects.
+ */
+typedef enum {
+  LED_EFFECT_STANDBY_BREATHE, /**< Blue breathing on all LEDs */
+  LED_EFFECT_MANUAL, /**< Yellow on all LEDs */
+  LED_EFFECT_ARROW_FORWARD, /**< Red arrow forward */
+  LED_EFFECT_ARROW_BACKWARD, /**< Red arrow backward */
+  LED_EFFECT_ARROW_LEFT, /**< Red arrow left */
+  LED_EFFECT_ARROW_RIGHT, /**< Red arrow right */
+  LED_EFFECT_FLASH, /**< White flash on all LEDs for 100 ms */
+  NUMBER_OF_LED_EFFECTS
+} ledEffectName_t;
+
 /**
  * @brief Sets up the LED module.
  */
 void setupLED();
 
+/**
+ * @brief Sets the color of one or all LEDs in the framebuffer, shown by the next showLEDs().
+ * @param index The LED (1-12), 0 sets all LEDs.
+ * @param r Red component value (0-255).
+ * @param g Green component value (0-255).
+ * @param b Blue component value (0-255).
+ * @return True if the index exists, otherwise false.
+ */
+bool setLEDColor(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
+
+/**
+ * @brief Draws the effects and sends the framebuffer to the LEDs if it differs from the frame last sent, at most LED_MAX_FRAME_RATE_HZ times per second.
+ */
+void showLEDs();
+
+/**
+ * @brief Sends the framebuffer to the LEDs right away, ignoring the frame rate limit.
+ */
+void showLEDsNow();
+
+/**
+ * @brief Starts an effect on a layer. Starting the looping effect that is already playing keeps it going undisturbed.
+ * @param layer The layer.
+ * @param effect The effect.
+ */
+void playLEDEffect(ledLayer_t layer, ledEffectName_t effect);
+
+/**
+ * @brief Stops the effect on a layer.
+ * @param layer The layer.
+ */
+void stopLEDEffect(ledLayer_t layer);
+
 /**
  * @brief Resets the state of LEDs.
  */
 void resetStateLEDs();
 
+/**
+ * @brief Performs an LED tick, showing the robot state and the direction of movement.
+ */
+void doLEDTick();
+
+/**
+ * @brief Activates the arrow LEDs of the current direction of movement.
+ */
+void activateManualDirectionLEDs();
+
 /**
  * @brief Deactivates all LEDs.
  */
 void deactivateLEDs();
 
 /**
- * @brief Activates all RGB LEDs with a specified color and optional delay time.
- * @param r Red component value (0-255).
- * @param g Green component value (0-255).
- * @param b Blue component value (0-255).
- * @param delayTime Optional delay time between activations (default: 100 milliseconds).
+ * @brief Flashes all LEDs white once.
  */
-void activateAllLEDsRGB(int r, int g, int b, unsigned long delayTime = 100);
+void activateFlashLEDs();
 
 /**
  * @brief Activates LEDs to indicate the standby state.
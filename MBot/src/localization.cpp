@@ -3,78 +3,177 @@
 #include "gyro.h"
 #include "encoder.h"
 #include "localization.h"
+#include "profiler.h"
+#include "pose_history.h"
+
+//Q16.16 millimeters, about 32 m in every direction from the start
+fixed_t coordinateX = 0;
+fixed_t coordinateY = 0;
+
+//Encoder counts and gyro heading at the last integration step
+encoderSnapshot_t odometryLastSnapshot;
+binaryAngle_t odometryLastHeading = 0;
+unsigned long odometryTimeMillis = 0;
+
+//Covariance of X, Y (mm) and the heading (rad), the matrix is symmetric so only one half is kept
+typedef struct {
+  float xx;
+  float xy;
+  float yy;
+  float xHeading;
+  float yHeading;
+  float headingHeading;
+} poseCovariance_t;
+
+poseCovariance_t poseCovariance = {0, 0, 0, 0, 0, 0};
+
+void setupLocalization(){
+  getEncoderSnapshot(&odometryLastSnapshot);
+  odometryLastHeading = getGyroBinaryHeading();
+  odometryTimeMillis = millis();
+}
 
-int coordinateX = 0;
-int coordinateY = 0;
-
-//We only want to update the Pi with coordinates with a certain interval, storing the last time we updated is done in a variable
-long timeForNextLocationTick = 0;
+/*
+ * P = F P F^T + Q for x += d sin(h), y -= d cos(h). F only couples the position to the heading, through the change of
+ * the step with the heading (d cos(h), d sin(h)). Q holds the noise of the distance along the direction of travel and
+ * the noise the gyro added to the heading during the step. The covariance stays in float for the range of squared
+ * millimeters, the odometry step itself is integer math.
+ */
+static void updatePoseCovariance(fixed_t stepDistance, int16_t sinHeading, int16_t cosHeading, int16_t stepHeadingChange, float stepSeconds){
+  float distance = fixedToFloat(stepDistance);
+  float headingChange = stepHeadingChange * (2 * M_PI / 65536);
+  float sine = sinHeading * (1.0 / FIXED_Q15_ONE);
+  float cosine = cosHeading * (1.0 / FIXED_Q15_ONE);
+  float xChangePerHeading = distance * cosine;
+  float yChangePerHeading = distance * sine;
+  poseCovariance_t *p = &poseCovariance;
+
+  p->xx += 2 * xChangePerHeading * p->xHeading + xChangePerHeading * xChangePerHeading * p->headingHeading;
+  p->xy += xChangePerHeading * p->yHeading + yChangePerHeading * p->xHeading + xChangePerHeading * yChangePerHeading * p->headingHeading;
+  p->yy += 2 * yChangePerHeading * p->yHeading + yChangePerHeading * yChangePerHeading * p->headingHeading;
+  p->xHeading += xChangePerHeading * p->headingHeading;
+  p->yHeading += yChangePerHeading * p->headingHeading;
+
+  float distanceVariance = ODOMETRY_DISTANCE_VARIANCE_PER_MM * fabs(distance);
+  p->xx += distanceVariance * sine * sine;
+  p->xy -= distanceVariance * sine * cosine;
+  p->yy += distanceVariance * cosine * cosine;
+  p->headingHeading += ODOMETRY_HEADING_VARIANCE_PER_S * stepSeconds + ODOMETRY_HEADING_VARIANCE_PER_RAD * fabs(headingChange);
+}
 
-//Tick that checks whether we should update our coordinates or wait until the timer has reset
+//Runs from its own scheduler task, the pose is sent by the telemetry stream and kept in the history for queries
 void doLocalizationTick(){
-  if(millis() > timeForNextLocationTick){
-    timeForNextLocationTick = millis() + AUTONOMOUS_LOCATION_TICK_TIME_MS;
-
-    calculateAndUpdateXAndYCoordinates();
-
-    sendSerialCoordinates();
-  }
+  PROFILE_START(PROFILE_LOCALIZATION);
+  calculateAndUpdateXAndYCoordinates();
+  recordPoseHistory();
+  PROFILE_END(PROFILE_LOCALIZATION);
 }
 
-//This function calculates what the coordinates should be when called and sets them in the global variables
+/*
+ * Midpoint integration: the distance of the step is driven along the heading halfway through the step, which is exact
+ * for a constant turn rate. Nothing is reset, the counts are taken as differences to the last step so no pulse is lost
+ * between reading and resetting the encoders.
+ */
 void calculateAndUpdateXAndYCoordinates(){
-  float newXCoordinate;
-  float newYCoordinate;
-  
-  setGyroValueAtEnd(getGyroZ());
-  
-  float calcTemp = ((getAverageGyroValue() + LOCALIZATION_CIRCLE_ROTATION_OFFSET) * DEGREES_TO_RADIAN_FACTOR);
+  encoderSnapshot_t snapshot;
+  getEncoderSnapshot(&snapshot);
+  binaryAngle_t heading = getGyroBinaryHeading();
+
+  fixed_t encoder1Distance = (snapshot.encoder1Pulses - odometryLastSnapshot.encoder1Pulses) * getEncoderMillimeterPerCountFixed(1);
+  fixed_t encoder2Distance = (snapshot.encoder2Pulses - odometryLastSnapshot.encoder2Pulses) * getEncoderMillimeterPerCountFixed(2);
+  fixed_t distance = (encoder2Distance - encoder1Distance) / 2; //encoder 1 is inverted physically
+
+  //A step turns far less than half a circle, so the signed difference is the turn even across the wrap
+  int16_t headingChange = (int16_t)(heading - odometryLastHeading);
+  binaryAngle_t midpointHeading = odometryLastHeading + headingChange / 2;
+  int16_t sinHeading = fixedSin(midpointHeading);
+  int16_t cosHeading = fixedCos(midpointHeading);
+  coordinateX = fixedAdd(coordinateX, fixedMulQ15(distance, sinHeading));
+  coordinateY = fixedSub(coordinateY, fixedMulQ15(distance, cosHeading));
+
+  float stepSeconds = (snapshot.timeMicros - odometryLastSnapshot.timeMicros) * 1e-6;
+  updatePoseCovariance(distance, sinHeading, cosHeading, headingChange, stepSeconds);
+
+  odometryLastSnapshot = snapshot;
+  odometryLastHeading = heading;
+  odometryTimeMillis = millis();
+}
 
-  newYCoordinate = getCoordinateY() + (getDistanceTravelled() * (sin(calcTemp)) *-1); //*-1 due to Canvas-inversion in app
-  newXCoordinate = getCoordinateX() + (getDistanceTravelled() * (cos(calcTemp) *-1)); //same as above
+static uint16_t toDeviation(float variance, float scale){
+  float deviation = sqrt(variance) * scale;
+  return deviation < 65535 ? (uint16_t)(deviation + 0.5) : 65535;
+}
 
-  setCoordinateX(newXCoordinate);
-  setCoordinateY(newYCoordinate);
+static int8_t toCorrelation(float covariance, float variance1, float variance2){
+  float product = variance1 * variance2;
+  if(product <= 0){
+    return 0;
+  }
+  float correlation = covariance / sqrt(product);
+  return (int8_t)(constrain(correlation, -1.0, 1.0) * 127);
+}
 
-  resetEncoderValues();
+void getPoseReport(poseReport_t *report){
+  const poseCovariance_t *p = &poseCovariance;
+  report->x = getCoordinateX();
+  report->y = getCoordinateY();
+  report->headingCentidegrees = (int32_t)(int16_t)odometryLastHeading * 36000L / 65536;
+  report->timeMillis = odometryTimeMillis;
+  report->deviationX = toDeviation(p->xx, 1);
+  report->deviationY = toDeviation(p->yy, 1);
+  report->deviationHeadingCentidegrees = toDeviation(p->headingHeading, 18000 / M_PI);
+  report->correlationXY = toCorrelation(p->xy, p->xx, p->yy);
+  report->correlationXHeading = toCorrelation(p->xHeading, p->xx, p->headingHeading);
+  report->correlationYHeading = toCorrelation(p->yHeading, p->yy, p->headingHeading);
 }
 
 //Knowing how many pulses are generated per millimeter makes sure that the calculation is correct even when battery is low/robot moving slow
 float getDistanceTravelled(){
-  return (getEncoderAverage() * MILLIMETER_PER_ENCOER_PULSE);
+  return getEncoderDistanceAverage();
 }
 
 void printCoordinates(){
-  Serial.println("Coordinate X: " + String(getCoordinateX()));
-  Serial.println("Coordinate Y: " + String(getCoordinateY()) + "\n");
+  sendDebugLine("Coordinate X: %d, Y: %d", getCoordinateX(), getCoordinateY());
 }
 
-//Following functions gets, sets or resets the coorinates
+//Following functions gets, sets or resets the coorinates, rounded to and from whole millimeters
 int getCoordinateX(){
-  return coordinateX;
+  return fixedToInt(coordinateX);
 }
 
 int getCoordinateY(){
+  return fixedToInt(coordinateY);
+}
+
+fixed_t getCoordinateXFixed(){
+  return coordinateX;
+}
+
+fixed_t getCoordinateYFixed(){
   return coordinateY;
 }
 
 void setCoordinateX(int value){
-  coordinateX = value;
+  coordinateX = fixedFromInt(value);
 }
 
 void setCoordinateY(int value){
-  coordinateY = value;
+  coordinateY = fixedFromInt(value);
 }
 
-void resetCoorinateX(){
+void resetCoordinateX(){
   coordinateX = 0;
 }
 
-void resetCoorinateY(){
+void resetCoordinateY(){
   coordinateY = 0;
 }
 
+//Also starts the odometry from the current counts, the encoders may just have been reset, with the pose known exactly
 void resetCoordinates(){
-  resetCoorinateX();
-  resetCoorinateY();
+  resetCoordinateX();
+  resetCoordinateY();
+  memset(&poseCovariance, 0, sizeof(poseCovariance));
+  setupLocalization();
+  clearPoseHistory();
 }
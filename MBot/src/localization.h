@@ -12,6 +12,16 @@
  * Position determination is based on these encoder values, offering millimeter accuracy for this robot.
  * However, prolonged use may result in position deviation.
  * Complementary GPS/GNSS, better encoders, or alternative methods to validate and calibrate encoder values can address this issue.
+ *
+ * The pose is integrated at TASK_LOCALIZATION_PERIOD_US from the encoder counts since the last step and the gyro
+ * heading, using the heading halfway through the step so the position stays right through turns. X and Y are kept in
+ * Q16.16 fixed point millimeters, so no fraction of a millimeter is lost between steps, and the step uses the sine
+ * table of fixed_point.h instead of soft float trigonometry. Heading 0 drives towards
+ * negative Y and a right turn towards positive X, matching the canvas of the app.
+ *
+ * Every step also carries the covariance of X, Y and the heading forward: the driven distance is uncertain in
+ * proportion to its length, the heading from the gyro in proportion to time and to the angle turned, and an uncertain
+ * heading spreads the position sideways as the robot drives on.
  */
 
 /**
@@ -19,6 +29,29 @@
  */
 
 #include <Arduino.h>
+#include "fixed_point.h"
+
+/**
+ * @brief Struct holding the pose of one odometry step with its uncertainty, sent as is in the binary protocol.
+ * The covariance is sent as standard deviations and correlations, which fit in far fewer bytes than the variances.
+ */
+typedef struct __attribute__((packed)) {
+  int16_t x; /**< X coordinate in millimeters */
+  int16_t y; /**< Y coordinate in millimeters */
+  int16_t headingCentidegrees; /**< Heading in centidegrees, wrapped to +-180 degrees */
+  uint32_t timeMillis; /**< Time of the step, from millis() */
+  uint16_t deviationX; /**< Standard deviation of X in millimeters */
+  uint16_t deviationY; /**< Standard deviation of Y in millimeters */
+  uint16_t deviationHeadingCentidegrees; /**< Standard deviation of the heading in centidegrees */
+  int8_t correlationXY; /**< Correlation of X and Y times 127 */
+  int8_t correlationXHeading; /**< Correlation of X and the heading times 127 */
+  int8_t correlationYHeading; /**< Correlation of Y and the heading times 127 */
+} poseReport_t;
+
+/**
+ * @brief Sets up the odometry from the current encoder counts and gyro heading, called after the gyro is set up.
+ */
+void setupLocalization();
 
 /**
  * @brief Executes a tick in the localization process.
@@ -26,30 +59,48 @@
 void doLocalizationTick();
 
 /**
- * @brief Calculates and updates the X and Y coordinates based on encoder values.
+ * @brief Integrates the encoder counts since the last call into the X and Y coordinates.
  */
 void calculateAndUpdateXAndYCoordinates();
 
 /**
- * @brief Retrieves the distance traveled based on encoder values.
- * @return The distance traveled.
+ * @brief Fills in the pose and covariance of the last odometry step.
+ * @param report The report to fill in.
+ */
+void getPoseReport(poseReport_t *report);
+
+/**
+ * @brief Retrieves the distance traveled since the encoders were reset.
+ * @return The distance traveled in millimeters, positive forward.
  */
 float getDistanceTravelled();
 
 /**
- * @brief Prints the current coordinates to the Serial output.
+ * @brief Prints the current coordinates to the serial port.
  */
 void printCoordinates();
 
 /**
  * @brief Retrieves the current X coordinate.
- * @return The X coordinate.
+ * @return The X coordinate in millimeters.
  */
 int getCoordinateX();
 
+/**
+ * @brief Retrieves the current X coordinate with its fraction.
+ * @return The X coordinate in Q16.16 fixed point millimeters.
+ */
+fixed_t getCoordinateXFixed();
+
+/**
+ * @brief Retrieves the current Y coordinate with its fraction.
+ * @return The Y coordinate in Q16.16 fixed point millimeters.
+ */
+fixed_t getCoordinateYFixed();
+
 /**
  * @brief Retrieves the current Y coordinate.
- * @return The Y coordinate.
+ * @return The Y coordinate in millimeters.
  */
 int getCoordinateY();
 
@@ -13,6 +13,12 @@
 #include "config.h"
 #include "localization.h"
 #include "current_state.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "profiler.h"
+#include "control_timer.h"
+#include "stored_settings.h"
+#include "speed_control.h"
 
 
 /*
@@ -31,39 +37,46 @@
 
 //Initiliazes sensors, serial, ports etc.
 void setup() {  
+  loadStoredSettings();
   setupSerial();
   setupEncoderInterrupts();
   setupMotors();
+  setupControlTimer();
+  setupSpeedControl();
   setCurrentState(STANDBY);
   setupLED();
   setupGyro();
+  setupLocalization();
+  setupTelemetry();
   randomSeed(analogRead(0));
+
+  addTask(doSerialTick, TASK_SERIAL_PERIOD_US);
+  addTask(doMotorControlTick, TASK_MOTOR_CONTROL_PERIOD_US);
+  addTask(updateGyro, TASK_GYRO_PERIOD_US);
+  addTask(doLocalizationTick, TASK_LOCALIZATION_PERIOD_US);
+  addTask(doLEDTick, TASK_LED_PERIOD_US);
+  addTask(doTelemetryTick, TASK_TELEMETRY_PERIOD_US);
+  addTask(doProfilerTick, TASK_PROFILER_PERIOD_US);
+  addTask(doStoredSettingsTick, TASK_STORED_SETTINGS_PERIOD_US);
 }
 
 /*
  * The following "loop()" is the main program of the Arduino.
  * 
- * It initializes by performing a serial tick, meaning that it will firstly check whether the Arduino should update based on timed
- * update-times but secondly read the data and store it for further use, seen in serial.ino
+ * It only runs the scheduler, the work is done by the tasks added in setup() at the rates set in config.h:
+ * a serial tick reads and acts on the commands from the Pi, seen in serial.cpp
+ * a motor control tick sets the wheel targets for the current state, seen in motorcontrol.cpp
+ * (the wheel speeds are regulated at a fixed rate by the Timer5 interrupt in control_timer.cpp)
+ * a gyro tick updates the gyro angles, a localization tick integrates the odometry, an LED tick shows the state, a telemetry tick sends the streams that are due,
+ * a stored settings tick writes saved settings to EEPROM one byte at a time, seen in stored_settings.cpp
  * 
- * The loop is designed to be structured in various self-explanatory states such as: standby and manual.
+ * The robot is designed to be structured in various self-explanatory states such as: standby and manual.
  * The standby-mode is simply a state where the robot is stationary and simply awaits orders.
  * Manual is the state where you MANUALLY control the robot via serial communication.
  * 
  */
 void loop() {
-  doSerialTick();
-
-  switch(getCurrentState()){
-    case(STANDBY):
-      resetStateLEDs();
-      stopMotors();
-      break;
-    case(MANUAL):
-      resetStateLEDs();
-      doManualControlTick();
-      break;
-  }
+  PROFILE_START(PROFILE_LOOP);
+  runScheduler();
+  PROFILE_END(PROFILE_LOOP);
 }
-
-
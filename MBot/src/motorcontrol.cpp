@@ -4,6 +4,12 @@
 #include "encoder.h"
 #include "gyro.h"
 #include "localization.h"
+#include "current_state.h"
+#include "profiler.h"
+#include "speed_control.h"
+#include "autotune.h"
+#include "calibration.h"
+#include "pwm_table.h"
 
 direction_t currentDirection = NONE;
 int motorSpeedManualPercentage = 100;
@@ -16,12 +22,38 @@ void setupMotors(){
   TCCR2B = _BV(CS21);
 }
 
+//Run by the scheduler at a fixed rate, sets the wheel targets of the current state and runs the wheel speed regulation unless the control timer does
+void doMotorControlTick(){
+  PROFILE_START(PROFILE_MOTOR_CONTROL);
+  switch(getCurrentState()){
+    case(STANDBY):
+      setMotorTargets(NONE, 0);
+      break;
+    case(MANUAL):
+      doManualControlTick();
+      break;
+    case(AUTOTUNE):
+      doAutotuneTick();
+      break;
+    case(CALIBRATION):
+      doCalibrationTick();
+      break;
+    case(PWM_SWEEP):
+      doPwmSweepTick();
+      break;
+  }
+#if !USE_WHEEL_CONTROL_TIMER
+  loopEncoders();
+#endif
+  PROFILE_END(PROFILE_MOTOR_CONTROL);
+}
+
 void doManualControlTick(){
   /*
    * If joystick is wanted:
    * moveBySeparateMotorSpeeds(calculateLeftMotorSpeed(currentJoysticSpeedLeftMotor, currentAngleJoystick),calculateRightMotorSpeed(currentJoysticSpeedRightMotor, currentAngleJoystick));
    */
-   move(getCurrentDirection(), getMotorSpeedManualPercentage() * PERCENTAGE_TO_PWM_FACTOR);
+   setMotorTargets(getCurrentDirection(), getMotorSpeedManualPercentage() * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 }
 
 int getMotorSpeedManualPercentage(){
@@ -37,31 +69,37 @@ void setMotorSpeedManualPercentage(int newMotorSpeedPercentage){
 /*
  * This is the main mowing function
  * This takes one input and one speed and the robot moves accordingly.
+ * Used by the blocking drive and rotate routines, which also need the LEDs, encoders and gyro updated while they wait.
  */
 void move(direction_t direction, float speedVal)
 {
+  setMotorTargets(direction, speedVal);
+  activateManualDirectionLEDs();
+  showLEDs();
+  _loop();
+}
+
+//Sets the wheel speed targets for a direction, without touching LEDs or sensors so it is cheap enough for the control task
+//The speed controllers keep both wheels at the same speed, so no deviation factor is needed
+void setMotorTargets(direction_t direction, float speedVal){
   setCurrentDirection(direction);
   float leftSpeed = 0;
   float rightSpeed = 0;
   
   if(getCurrentDirection() == FORWARD){
-    activateManualForwardLEDs();
-    leftSpeed = -speedVal * MOTOR_DEVIATION_FACTOR;
+    leftSpeed = -speedVal;
     rightSpeed = speedVal;
   }
   else if(getCurrentDirection() == BACKWARD){
-    activateManualBackwardLEDs();
-    leftSpeed = speedVal * MOTOR_DEVIATION_FACTOR;
+    leftSpeed = speedVal;
     rightSpeed = -speedVal;
   }
   else if(getCurrentDirection() == LEFT){
-    activateManualLeftLEDs();
-    leftSpeed = -speedVal * MOTOR_DEVIATION_FACTOR;
+    leftSpeed = -speedVal;
     rightSpeed = -speedVal;
   }
   else if(getCurrentDirection() == RIGHT){
-    activateManualRightLEDs();
-    leftSpeed = speedVal * MOTOR_DEVIATION_FACTOR;
+    leftSpeed = speedVal;
     rightSpeed = speedVal;
   }
   else if(getCurrentDirection() == NONE) {
@@ -69,139 +107,62 @@ void move(direction_t direction, float speedVal)
     rightSpeed = 0;
   }
   
-  setEncoderPwm(1, leftSpeed);
-  setEncoderPwm(2, rightSpeed);
-
-  _loop();
+  setWheelSpeedTargets(leftSpeed, rightSpeed);
 }
 
 //If we want the robot to move based on distance
+//The encoders are not reset, the odometry integrates their counts
 void driveDistance(int millimeters, direction_t movingDirection, int motorSpeed){
-  resetEncoderValues();
+  float distanceAtStart = getDistanceTravelled();
 
-  while((abs(getDistanceTravelled()) < millimeters - MILLIMETER_DISTANCE_WHEN_FREE_ROLLING_AFTER_FULL_SPEED)){
-    Serial.println(getDistanceTravelled());
+  while((abs(getDistanceTravelled() - distanceAtStart) < millimeters - MILLIMETER_DISTANCE_WHEN_FREE_ROLLING_AFTER_FULL_SPEED)){
     move(movingDirection, motorSpeed);
   }
-  //Serial.println("Gyro in driveDistance: " + String(getGyroZ()));
+  //sendDebugLine("Gyro in driveDistance: %d", (int)(getGyroZ() * 100));
 }
 
 //If we want the robot to move based on time
 void driveTime(int ms, direction_t movingDirection, int motorSpeed){
-  resetEncoderValues();
   long timeWhenDone = millis() + ms;
 
   while(millis() < timeWhenDone){
     move(movingDirection, motorSpeed);
   }
-  //Serial.println("Gyro in driveTime: " + String(getGyroZ()));
+  //sendDebugLine("Gyro in driveTime: %d", (int)(getGyroZ() * 100));
 }
 
-//This function makes the robot rotate, this works with angles ove 360 degrees (making it do full turns as well)
+//This function makes the robot rotate, this works with angles over 360 degrees since the gyro heading does not wrap
 void rotateByDegrees(int degreesToRotate, direction_t rotateLeftOrRight, int motorSpeed) {
   if(rotateLeftOrRight == LEFT){
-    if(calculateFullCirclesNeeded(degreesToRotate) > 0){
-      rotateFullCircles(calculateFullCirclesNeeded(degreesToRotate), rotateLeftOrRight, motorSpeed);
-    }
-    
-    int calcDegreesToRotate = getGyroZ() - ((degreesToRotate - ROTATING_LEFT_MOMENTUM_OFFSET) % 360);
-
-    if(calcDegreesToRotate >= -180){
-      while(getGyroZ() > calcDegreesToRotate){
-        move(LEFT, motorSpeed);
-      }
-    }
-    else{
-      int degreesDelta = abs(calcDegreesToRotate) % 180;
-      int degreeToRotateTo = (180 - degreesDelta) * 1;
-      
-      bool wasInLowerValueHalf = false;
-      bool wentOverHighestPeak = false;
-      
-      while(!wentOverHighestPeak){
-        move(LEFT, motorSpeed);
-        if(getGyroZ() >= -180 && getGyroZ() < 90){wasInLowerValueHalf = true;}
-        if(wasInLowerValueHalf && getGyroZ() > 90){wentOverHighestPeak = true;}
-      }
-      while(getGyroZ() > degreeToRotateTo){
-        move(LEFT, motorSpeed);
-      }
+    float targetHeading = getGyroHeading() - (degreesToRotate - ROTATING_LEFT_MOMENTUM_OFFSET);
+    while(getGyroHeading() > targetHeading){
+      move(LEFT, motorSpeed);
     }
   }
-  
   else if(rotateLeftOrRight == RIGHT){
-    if(calculateFullCirclesNeeded(degreesToRotate) > 0){
-      rotateFullCircles(calculateFullCirclesNeeded(degreesToRotate), rotateLeftOrRight, motorSpeed);
-    }
-
-    int calcDegreesToRotate = getGyroZ() + ((degreesToRotate - ROTATING_RIGHT_MOMENTUM_OFFSET) % 360);
-
-    if(calcDegreesToRotate <= 180){
-      while(getGyroZ() < calcDegreesToRotate){
-        move(RIGHT, motorSpeed);
-      }
-    }
-    else{
-      int degreesDelta = abs(calcDegreesToRotate) % 180;
-      int degreeToRotateTo = (180 - degreesDelta) * -1;
-      
-      bool wasInUpperValueHalf = false;
-      bool wentOverHighestPeak = false;
-      
-      while(!wentOverHighestPeak){
-        move(RIGHT, motorSpeed);
-        if(getGyroZ() > 0 && getGyroZ() <= 180){wasInUpperValueHalf = true;}
-        if(wasInUpperValueHalf && getGyroZ() < -90){wentOverHighestPeak = true;}
-      }
-      while(getGyroZ() < degreeToRotateTo){
-        move(RIGHT, motorSpeed);
-      }
+    float targetHeading = getGyroHeading() + (degreesToRotate - ROTATING_RIGHT_MOMENTUM_OFFSET);
+    while(getGyroHeading() < targetHeading){
+      move(RIGHT, motorSpeed);
     }
   }
   else{
-    //Serial.println("Recieved wrong parameter in: rotateByDegrees");
+    //sendDebugLine("Recieved wrong parameter in: rotateByDegrees");
   }
   stopMotorsMS(200);
 }
 
 //Takes the amount of cirles you want to make the robot turn and does so with the initial gyro value as start and end point
 void rotateFullCircles(int amountOfCircles, direction_t rotateLeftOrRight, int motorSpeed){
-  for(int i = 0; i < amountOfCircles; i++){
-    int angleNow = getGyroZ();
-    
-    bool beenInFirstQuadrant = false;
-    bool beenInSecondQuadrant = false;
-    bool beenInThirdQuadrant = false;
-    bool beenInFourthQuadrant = false;
-    
-    bool circleRotated = false;
-
-    //Rotate until first half of the circle is completed
-    while(!circleRotated){
-      if(getGyroZ() <= 0 && getGyroZ() > -90){beenInSecondQuadrant = true;}
-      else if(getGyroZ() <= -90 && getGyroZ() > -180){beenInThirdQuadrant = true;}
-      else if(getGyroZ() <= 180 && getGyroZ() > 90){beenInFourthQuadrant = true;}
-      else if(getGyroZ() <= 90 && getGyroZ() > 0){beenInFirstQuadrant = true;}
-
-      if(beenInFirstQuadrant && beenInSecondQuadrant && beenInThirdQuadrant && beenInFourthQuadrant){
-        if(rotateLeftOrRight == LEFT){
-          while(getGyroZ() > angleNow){
-            //Serial.println(getGyroZ());
-            move(rotateLeftOrRight, motorSpeed);
-          }
-          circleRotated = true;
-        }
-        else if(rotateLeftOrRight == RIGHT){
-          while(getGyroZ() < angleNow){
-            //Serial.println(getGyroZ());
-            move(rotateLeftOrRight, motorSpeed);
-          }
-          circleRotated = true;
-        }
-      }
-
+  if(rotateLeftOrRight == LEFT){
+    float targetHeading = getGyroHeading() - 360.0 * amountOfCircles;
+    while(getGyroHeading() > targetHeading){
+      move(rotateLeftOrRight, motorSpeed);
+    }
+  }
+  else if(rotateLeftOrRight == RIGHT){
+    float targetHeading = getGyroHeading() + 360.0 * amountOfCircles;
+    while(getGyroHeading() < targetHeading){
       move(rotateLeftOrRight, motorSpeed);
-      //Serial.println(getGyroZ());
     }
   }
 }
@@ -212,9 +173,9 @@ int calculateFullCirclesNeeded(int degreesToRotate){
 }
 
 //Used when both motors should move with various speeds, used in conjuction with joystick steering
+//Encoder 1 drives the right wheel and is mounted inverted, so it counts down when driving forward
 void moveBySeparateMotorSpeeds(int speedLeftMotor, int speedRightMotor){
-  setEncoder1TarPWM(speedRightMotor);
-  setEncoder2TarPWM(speedLeftMotor);
+  setWheelSpeedTargets(-speedRightMotor, speedLeftMotor);
 }
 
 //Used for turning either right or left when in autonomous mode
@@ -243,7 +204,10 @@ direction_t getCurrentDirection(){
   return currentDirection;
 }
 
+//Open loop, used by the diagnostics, turns the speed control off until the next speed target
 void setEncoderPwm(int encoderNumber, int pwmValue){
+  stopWheelSpeedControl();
+  pwmValue = linearizePwm(encoderNumber, pwmValue);
   //The in-built library is playing tricks with magic numbers: it removes a total of 2 in value if the speed is 2 or -2, or 1 if the value is 1 or -1 since it wants the motors to ramp up/down and have a safety margin of 2.
   if(encoderNumber == 1){
     if(pwmValue > 0){
@@ -278,8 +242,12 @@ void stopMotorsMS(int ms) {
 }
 
 void _loop() {
+  PROFILE_START(PROFILE_MOVE_LOOP);
+#if !USE_WHEEL_CONTROL_TIMER
   loopEncoders();
+#endif
   updateGyro();
+  PROFILE_END(PROFILE_MOVE_LOOP);
 }
 
 
@@ -328,14 +296,26 @@ bool moveTest(direction_t robotDirection, int motorspeed)
     leftSpeed = 0;
     rightSpeed = 0;
   }
-;
-  driveTime(1000, getCurrentDirection(), motorspeed);
 
-  if(getEncoder1CurPwm() != leftSpeed || getEncoder2CurPwm() != rightSpeed || getCurrentDirection() != robotDirection){
+  //Tests the PWM of the encoder library, so the speed control is bypassed with open loop values
+  setEncoderPwm(1, leftSpeed);
+  setEncoderPwm(2, rightSpeed);
+  unsigned long timeWhenDone = millis() + 1000;
+  while(millis() < timeWhenDone){
+    _loop();
+  }
+
+  if(getEncoder1CurPwm() != linearizePwm(1, leftSpeed) || getEncoder2CurPwm() != linearizePwm(2, rightSpeed) || getCurrentDirection() != robotDirection){
     errorEncoutered = true;
   }
 
-  stopMotorsMS(1000);
+  setEncoderPwm(1, 0);
+  setEncoderPwm(2, 0);
+  setCurrentDirection(NONE);
+  timeWhenDone = millis() + 1000;
+  while(millis() < timeWhenDone){
+    _loop();
+  }
 
   if(getEncoder1CurPwm() != 0 || getEncoder2CurPwm() != 0 || getCurrentDirection() != NONE){
     errorEncoutered = true;
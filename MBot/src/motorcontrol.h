@@ -25,19 +25,93 @@ typedef enum {
  */
 void setupMotors();
 
+/**
+ * @brief Performs a motor control tick: sets the wheel targets for the current state and regulates the wheel speeds.
+ */
+void doMotorControlTick();
+
 /**
  * @brief Performs a tick for manual control operations.
  */
 void doManualControlTick();
 
 /**
- * @brief Moves the robot in a specified direction at a particular speed.
+ * @brief Retrieves the motor speed used in manual mode.
+ * @return The motor speed in percent.
+ */
+int getMotorSpeedManualPercentage();
+
+/**
+ * @brief Sets the motor speed used in manual mode.
+ * @param newMotorSpeedPercentage The motor speed in percent (0-100).
+ */
+void setMotorSpeedManualPercentage(int newMotorSpeedPercentage);
+
+/**
+ * @brief Moves the robot in a specified direction at a particular speed, updating LEDs, encoders and gyro.
  * @param direction The direction to move in.
- * @param speedVal The speed value for movement.
+ * @param speedVal The wheel speed in millimeters per second.
  */
 void move(direction_t direction, float speedVal);
 
-// ... (Other function declarations)
+/**
+ * @brief Sets the wheel speed targets for moving in a specified direction at a particular speed.
+ * @param direction The direction to move in.
+ * @param speedVal The wheel speed in millimeters per second.
+ */
+void setMotorTargets(direction_t direction, float speedVal);
+
+/**
+ * @brief Drives a distance, blocking until it is reached.
+ * @param millimeters The distance to drive.
+ * @param movingDirection The direction to drive in.
+ * @param motorSpeed The wheel speed in millimeters per second.
+ */
+void driveDistance(int millimeters, direction_t movingDirection, int motorSpeed);
+
+/**
+ * @brief Drives for a time, blocking until it has passed.
+ * @param ms The time to drive in milliseconds.
+ * @param movingDirection The direction to drive in.
+ * @param motorSpeed The wheel speed in millimeters per second.
+ */
+void driveTime(int ms, direction_t movingDirection, int motorSpeed);
+
+/**
+ * @brief Rotates by a number of degrees using the gyro, blocking until done.
+ * @param degreesToRotate The degrees to rotate, may be more than 360.
+ * @param rotateLeftOrRight The direction to rotate in (LEFT or RIGHT).
+ * @param motorSpeed The wheel speed in millimeters per second.
+ */
+void rotateByDegrees(int degreesToRotate, direction_t rotateLeftOrRight, int motorSpeed);
+
+/**
+ * @brief Rotates full circles using the gyro, blocking until done.
+ * @param amountOfCircles The number of circles.
+ * @param rotateLeftOrRight The direction to rotate in (LEFT or RIGHT).
+ * @param motorSpeed The wheel speed in millimeters per second.
+ */
+void rotateFullCircles(int amountOfCircles, direction_t rotateLeftOrRight, int motorSpeed);
+
+/**
+ * @brief Calculates the number of full circles in a rotation.
+ * @param degreesToRotate The degrees to rotate.
+ * @return The number of full circles.
+ */
+int calculateFullCirclesNeeded(int degreesToRotate);
+
+/**
+ * @brief Sets separate speed targets for both wheels, positive is forward.
+ * @param speedLeftMotor The speed target of the left wheel in millimeters per second.
+ * @param speedRightMotor The speed target of the right wheel in millimeters per second.
+ */
+void moveBySeparateMotorSpeeds(int speedLeftMotor, int speedRightMotor);
+
+/**
+ * @brief Randomly picks a turning direction.
+ * @return LEFT or RIGHT.
+ */
+direction_t randomLeftOrRight();
 
 /**
  * @brief Stops the motors.
@@ -57,7 +131,8 @@ void setCurrentDirection(direction_t newDirection);
 direction_t getCurrentDirection();
 
 /**
- * @brief Sets the PWM value for an encoder.
+ * @brief Sets an open loop PWM value for an encoder through the encoder library, turning the speed control off.
+ * With a measured PWM table the value is linearized first, so the same value gives about the same speed on both wheels.
  * @param encoderNumber The encoder number.
  * @param pwmValue The PWM value to set.
  */
@@ -0,0 +1,108 @@
+#include "pose_history.h"
+
+//Only the pose is stored, the covariance of a query comes from the newest step
+typedef struct {
+  uint32_t timeMillis;
+  int16_t x;
+  int16_t y;
+  int16_t headingCentidegrees;
+} poseHistoryEntry_t;
+
+poseHistoryEntry_t poseHistory[POSE_HISTORY_SIZE];
+uint8_t poseHistoryNewest = 0;
+uint8_t poseHistoryCount = 0;
+uint8_t poseHistoryStepsSkipped = 0;
+
+void recordPoseHistory(){
+  //Counted in odometry steps, a period in ms would round up to whole steps anyway
+  if(poseHistoryCount > 0 && ++poseHistoryStepsSkipped < POSE_HISTORY_ODOMETRY_STEPS){
+    return;
+  }
+  poseHistoryStepsSkipped = 0;
+
+  poseReport_t report;
+  getPoseReport(&report);
+
+  poseHistoryNewest = (poseHistoryNewest + 1) % POSE_HISTORY_SIZE;
+  poseHistoryEntry_t *entry = &poseHistory[poseHistoryNewest];
+  entry->timeMillis = report.timeMillis;
+  entry->x = report.x;
+  entry->y = report.y;
+  entry->headingCentidegrees = report.headingCentidegrees;
+  if(poseHistoryCount < POSE_HISTORY_SIZE){
+    poseHistoryCount++;
+  }
+}
+
+void clearPoseHistory(){
+  poseHistoryCount = 0;
+}
+
+static void copyPoseHistoryEntry(const poseHistoryEntry_t *entry, poseReport_t *report){
+  report->timeMillis = entry->timeMillis;
+  report->x = entry->x;
+  report->y = entry->y;
+  report->headingCentidegrees = entry->headingCentidegrees;
+}
+
+//The heading is interpolated the short way around, so a step across +-180 degrees does not pass through 0
+static int16_t interpolateHeading(int16_t older, int16_t newer, float fraction){
+  int32_t change = (int32_t)newer - older;
+  if(change > 18000){
+    change -= 36000;
+  }
+  else if(change < -18000){
+    change += 36000;
+  }
+  int32_t heading = older + (int32_t)(change * fraction);
+  if(heading >= 18000){
+    heading -= 36000;
+  }
+  else if(heading < -18000){
+    heading += 36000;
+  }
+  return heading;
+}
+
+/*
+ * Searched from the current pose backwards, a camera frame is normally only a few hundred milliseconds old. The current
+ * pose is the newest point, so a time after the last stored entry is still interpolated. Times are compared as
+ * differences so the wrap of millis() does not matter.
+ */
+static poseQueryStatus_t findPoseAtTime(uint32_t timeMillis, poseReport_t *report){
+  getPoseReport(report);
+  if((long)(timeMillis - report->timeMillis) > 0){
+    return POSE_QUERY_TOO_NEW;
+  }
+
+  poseHistoryEntry_t current = {report->timeMillis, report->x, report->y, report->headingCentidegrees};
+  const poseHistoryEntry_t *newer = &current;
+  uint8_t index = poseHistoryNewest;
+  for(uint8_t i = 0; i < poseHistoryCount; i++){
+    const poseHistoryEntry_t *older = &poseHistory[index];
+    if(timeMillis == older->timeMillis){
+      copyPoseHistoryEntry(older, report);
+      return POSE_QUERY_OK;
+    }
+    if((long)(timeMillis - older->timeMillis) > 0){
+      float fraction = (float)(timeMillis - older->timeMillis) / (newer->timeMillis - older->timeMillis);
+      report->x = older->x + (int16_t)((newer->x - older->x) * fraction);
+      report->y = older->y + (int16_t)((newer->y - older->y) * fraction);
+      report->headingCentidegrees = interpolateHeading(older->headingCentidegrees, newer->headingCentidegrees, fraction);
+      return POSE_QUERY_OK;
+    }
+    newer = older;
+    index = (index + POSE_HISTORY_SIZE - 1) % POSE_HISTORY_SIZE;
+  }
+
+  //Before the oldest pose, or at the current pose when nothing is stored yet
+  copyPoseHistoryEntry(newer, report);
+  return timeMillis == newer->timeMillis ? POSE_QUERY_OK : POSE_QUERY_TOO_OLD;
+}
+
+//The asked time is always returned, so the Pi can match the answer with its query
+poseQueryStatus_t getPoseAtTime(uint32_t timeMillis, poseReport_t *report){
+  poseQueryStatus_t status = findPoseAtTime(timeMillis, report);
+  report->timeMillis = timeMillis;
+  return status;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file pose_history.h
+ * @brief Header file containing the history of recent odometry poses.
+ */
+
+#ifndef POSE_HISTORY_H
+#define POSE_HISTORY_H
+
+/**
+ * @brief This module keeps every POSE_HISTORY_ODOMETRY_STEPS-th odometry pose, POSE_HISTORY_SIZE of them in a ring
+ * buffer (3.84 s with the 20 ms localization task), so a measurement that reaches the Pi late (a camera frame) can be
+ * matched with the pose at the time it was taken instead of the newest one.
+ *
+ * The Pi asks with "pq:<time ms>", the time on the millis() clock of the MBot, and gets the pose interpolated between
+ * the two poses around that time, the current odometry pose counting as the newest. The covariance is the one of the
+ * newest step, it only grows, so it is an upper bound of the one at the asked time. The history is cleared when the coordinates are reset.
+ * On the binary link the queries are sent outside the command numbering, they are only answered with the pose.
+ */
+
+#include <Arduino.h>
+#include "config.h"
+#include "localization.h"
+
+/**
+ * @brief Enum defining the results of a pose query, the values are used by the Pi to name them.
+ */
+typedef enum {
+  POSE_QUERY_OK, /**< The pose was interpolated at the asked time */
+  POSE_QUERY_TOO_OLD, /**< The asked time is older than the history, the oldest pose is returned */
+  POSE_QUERY_TOO_NEW /**< The asked time is after the last odometry step, the current pose is returned */
+} poseQueryStatus_t;
+
+/**
+ * @brief Stores the pose of the last odometry step once every POSE_HISTORY_ODOMETRY_STEPS calls, run after each step.
+ */
+void recordPoseHistory();
+
+/**
+ * @brief Removes all stored poses.
+ */
+void clearPoseHistory();
+
+/**
+ * @brief Looks up the pose at a time in the history.
+ * @param timeMillis The time on the millis() clock.
+ * @param report The report to fill in with the pose, the newest covariance and the asked time.
+ * @return The result of the query, the closest stored pose is returned when the time is outside of the history.
+ */
+poseQueryStatus_t getPoseAtTime(uint32_t timeMillis, poseReport_t *report);
+
+#endif // POSE_HISTORY_H
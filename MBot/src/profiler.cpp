@@ -0,0 +1,78 @@
+#include <util/atomic.h>
+#include "serial.h"
+#include "profiler.h"
+
+typedef struct {
+  uint16_t samples;
+  uint16_t minMicros;
+  uint16_t maxMicros;
+  uint32_t sumMicros;
+  uint16_t histogram[PROFILE_HISTOGRAM_BUCKETS];
+} profileStatistics_t;
+
+profileStatistics_t profileStatistics[NUMBER_OF_PROFILE_SECTIONS];
+
+//Section to send next, NUMBER_OF_PROFILE_SECTIONS when no report is requested
+uint8_t nextProfileSectionToReport = NUMBER_OF_PROFILE_SECTIONS;
+
+//Every section must only be recorded from one context, the encoder section is recorded from the control timer interrupt
+void recordProfileSample(profileSection_t section, unsigned long sampleMicros){
+  profileStatistics_t *statistics = &profileStatistics[section];
+  uint16_t sample = sampleMicros > 0xFFFF ? 0xFFFF : sampleMicros;
+
+  if(statistics->samples == 0 || sample < statistics->minMicros){
+    statistics->minMicros = sample;
+  }
+  if(sample > statistics->maxMicros){
+    statistics->maxMicros = sample;
+  }
+  //The mean stops following new samples once the counter saturates, sections are reset at every report anyway
+  if(statistics->samples < 0xFFFF){
+    statistics->samples++;
+    statistics->sumMicros += sample;
+  }
+
+  uint8_t bucket = 0;
+  unsigned long bucketLimit = PROFILE_HISTOGRAM_FIRST_BUCKET_US;
+  while(bucket < PROFILE_HISTOGRAM_BUCKETS - 1 && sampleMicros >= bucketLimit){
+    bucket++;
+    bucketLimit <<= 1;
+  }
+  if(statistics->histogram[bucket] < 0xFFFF){
+    statistics->histogram[bucket]++;
+  }
+}
+
+void requestProfileReport(){
+  nextProfileSectionToReport = 0;
+}
+
+/*
+ * One section per tick, and only when its report fits next to the reserve kept for acks. The statistics are only reset
+ * once the report is queued, the few samples measured in between are lost.
+ */
+void doProfilerTick(){
+  if(nextProfileSectionToReport >= NUMBER_OF_PROFILE_SECTIONS){
+    return;
+  }
+
+  profileStatistics_t statistics;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    statistics = profileStatistics[nextProfileSectionToReport];
+  }
+
+  profileReport_t report;
+  report.section = nextProfileSectionToReport;
+  report.samples = statistics.samples;
+  report.minMicros = statistics.minMicros;
+  report.maxMicros = statistics.maxMicros;
+  report.meanMicros = statistics.samples > 0 ? statistics.sumMicros / statistics.samples : 0;
+  memcpy(report.histogram, statistics.histogram, sizeof(report.histogram));
+  if(!sendProfileTransmission(&report)){
+    return;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    memset(&profileStatistics[nextProfileSectionToReport], 0, sizeof(profileStatistics_t));
+  }
+  nextProfileSectionToReport++;
+}
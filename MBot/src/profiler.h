@@ -0,0 +1,76 @@
+/**
+ * @file profiler.h
+ * @brief Header file containing the run time profiler of the firmware subsystems.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/**
+ * @brief This module measures how long the subsystems take, using micros() around each of them.
+ * Every section collects the number of samples, min, max and mean and a histogram with log2-scaled buckets:
+ * bucket 0 counts samples below PROFILE_HISTOGRAM_FIRST_BUCKET_US, every next bucket doubles the limit and the last bucket counts the rest.
+ * The Pi requests a report with "prof", it is sent one section at a time in the background and every section is reset once sent.
+ * Setting PROFILER_ENABLED to 0 in config.h removes all measurements.
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * @brief Enum defining the profiled sections, the values are used by the Pi to name them.
+ */
+typedef enum {
+  PROFILE_LOOP, /**< One pass of loop() */
+  PROFILE_TASK_LATENESS, /**< Time between the release of a periodic task and its start, i.e. the scheduling jitter */
+  PROFILE_SERIAL, /**< doSerialTick() */
+  PROFILE_MOTOR_CONTROL, /**< doMotorControlTick() */
+  PROFILE_ENCODERS, /**< loopEncoders() */
+  PROFILE_GYRO, /**< updateGyro() */
+  PROFILE_MOVE_LOOP, /**< _loop(), used by the blocking drive and rotate routines */
+  PROFILE_LED_SHOW, /**< Sending a frame to the RGB LEDs */
+  PROFILE_TELEMETRY, /**< doTelemetryTick() */
+  PROFILE_LOCALIZATION, /**< doLocalizationTick() */
+  NUMBER_OF_PROFILE_SECTIONS
+} profileSection_t;
+
+/**
+ * @brief Struct holding the report of one section, sent as is in the binary protocol.
+ */
+typedef struct __attribute__((packed)) {
+  uint8_t section; /**< The section, see profileSection_t */
+  uint16_t samples; /**< Number of samples, saturates at 65535 */
+  uint16_t minMicros; /**< Shortest sample */
+  uint16_t maxMicros; /**< Longest sample, saturates at 65535 */
+  uint16_t meanMicros; /**< Mean of all samples */
+  uint16_t histogram[PROFILE_HISTOGRAM_BUCKETS]; /**< Number of samples per log2-scaled bucket */
+} profileReport_t;
+
+#if PROFILER_ENABLED
+#define PROFILE_START(section) unsigned long profileStart_##section = micros()
+#define PROFILE_END(section) recordProfileSample(section, micros() - profileStart_##section)
+#define PROFILE_SAMPLE(section, micros) recordProfileSample(section, micros)
+#else
+#define PROFILE_START(section)
+#define PROFILE_END(section)
+#define PROFILE_SAMPLE(section, micros)
+#endif
+
+/**
+ * @brief Adds a sample to a section, normally used through the PROFILE_ macros.
+ * @param section The section.
+ * @param micros The measured time in microseconds.
+ */
+void recordProfileSample(profileSection_t section, unsigned long micros);
+
+/**
+ * @brief Starts sending a report of every section to the Pi.
+ */
+void requestProfileReport();
+
+/**
+ * @brief Performs a profiler tick, sending the next section of a requested report if the transmit buffer has room.
+ */
+void doProfilerTick();
+
+#endif // PROFILER_H
@@ -0,0 +1,149 @@
+#include <util/crc16.h>
+#include "protocol.h"
+#include "uart.h"
+
+//Raw frame: type + payload + CRC16, encoded frame: raw frame + COBS overhead byte
+#define PROTOCOL_MAX_RAW_FRAME_SIZE (1 + PROTOCOL_MAX_PAYLOAD_SIZE + 2)
+#define PROTOCOL_MAX_ENCODED_FRAME_SIZE (PROTOCOL_MAX_RAW_FRAME_SIZE + 1)
+
+//Incoming frame is collected here until the 0x00 delimiter, then decoded in place
+uint8_t frameBuffer[PROTOCOL_MAX_ENCODED_FRAME_SIZE];
+uint8_t frameBufferLength = 0;
+uint8_t decodedFrameLength = 0;
+bool frameOverflow = false;
+unsigned int frameErrorCount = 0;
+
+/*
+ * Collects bytes until the frame delimiter is found, then COBS decodes and CRC checks the frame.
+ * Frames that are too long, wrongly encoded or have a bad CRC are dropped and counted.
+ */
+bool parseFrameByte(uint8_t b){
+  if(b != 0x00){
+    if(frameBufferLength < PROTOCOL_MAX_ENCODED_FRAME_SIZE){
+      frameBuffer[frameBufferLength++] = b;
+    }
+    else{
+      frameOverflow = true;
+    }
+    return false;
+  }
+
+  //Delimiter found, two delimiters in a row is just an empty frame and ignored
+  uint8_t encodedLength = frameBufferLength;
+  bool overflowed = frameOverflow;
+  resetFrameParser();
+  if(encodedLength == 0){
+    return false;
+  }
+
+  decodedFrameLength = overflowed ? 0 : cobsDecode(frameBuffer, encodedLength, frameBuffer);
+  if(decodedFrameLength < 3){
+    decodedFrameLength = 0;
+    frameErrorCount++;
+    return false;
+  }
+
+  uint8_t crcIndex = decodedFrameLength - 2;
+  uint16_t recievedCRC = frameBuffer[crcIndex] | ((uint16_t)frameBuffer[crcIndex + 1] << 8);
+  if(recievedCRC != calculateCRC16(frameBuffer, crcIndex)){
+    decodedFrameLength = 0;
+    frameErrorCount++;
+    return false;
+  }
+  return true;
+}
+
+uint8_t getFrameType(){
+  return frameBuffer[0];
+}
+
+const uint8_t *getFramePayload(){
+  return &frameBuffer[1];
+}
+
+uint8_t getFramePayloadLength(){
+  return decodedFrameLength >= 3 ? decodedFrameLength - 3 : 0;
+}
+
+unsigned int getFrameErrorCount(){
+  return frameErrorCount;
+}
+
+void resetFrameParser(){
+  frameBufferLength = 0;
+  frameOverflow = false;
+}
+
+bool sendFrame(uint8_t type, const void *payload, uint8_t length, uint8_t reserveBytes){
+  uint8_t rawFrame[PROTOCOL_MAX_RAW_FRAME_SIZE];
+  uint8_t encodedFrame[PROTOCOL_MAX_ENCODED_FRAME_SIZE + 1];
+
+  if(length > PROTOCOL_MAX_PAYLOAD_SIZE){
+    return false;
+  }
+
+  rawFrame[0] = type;
+  memcpy(&rawFrame[1], payload, length);
+  uint16_t crc = calculateCRC16(rawFrame, length + 1);
+  rawFrame[length + 1] = lowByte(crc);
+  rawFrame[length + 2] = highByte(crc);
+
+  uint8_t encodedLength = cobsEncode(rawFrame, length + 3, encodedFrame);
+  encodedFrame[encodedLength++] = 0x00;
+  //A frame held back for the reserve is sent later by its caller, so it is not counted as dropped
+  if(reserveBytes > 0 && PiSerial.availableForWrite() < encodedLength + reserveBytes){
+    return false;
+  }
+  return PiSerial.writeNonBlocking(encodedFrame, encodedLength);
+}
+
+/*
+ * Consistent Overhead Byte Stuffing: every 0x00 is replaced by the distance to the next 0x00,
+ * with one extra code byte in front. Frames here are always shorter than 254 bytes so no extra code blocks are needed.
+ */
+uint8_t cobsEncode(const uint8_t *input, uint8_t length, uint8_t *output){
+  uint8_t codeIndex = 0;
+  uint8_t writeIndex = 1;
+  uint8_t code = 1;
+
+  for(uint8_t readIndex = 0; readIndex < length; readIndex++){
+    if(input[readIndex] == 0x00){
+      output[codeIndex] = code;
+      codeIndex = writeIndex++;
+      code = 1;
+    }
+    else{
+      output[writeIndex++] = input[readIndex];
+      code++;
+    }
+  }
+  output[codeIndex] = code;
+  return writeIndex;
+}
+
+uint8_t cobsDecode(const uint8_t *input, uint8_t length, uint8_t *output){
+  uint8_t readIndex = 0;
+  uint8_t writeIndex = 0;
+
+  while(readIndex < length){
+    uint8_t code = input[readIndex++];
+    if(code == 0x00 || readIndex + code - 1 > length){
+      return 0;
+    }
+    for(uint8_t i = 1; i < code; i++){
+      output[writeIndex++] = input[readIndex++];
+    }
+    if(code != 0xFF && readIndex < length){
+      output[writeIndex++] = 0x00;
+    }
+  }
+  return writeIndex;
+}
+
+uint16_t calculateCRC16(const uint8_t *data, uint8_t length){
+  uint16_t crc = 0xFFFF;
+  for(uint8_t i = 0; i < length; i++){
+    crc = _crc_ccitt_update(crc, data[i]);
+  }
+  return crc;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file protocol.h
+ * @brief Header file containing the binary framed protocol used between the Pi and the MBot.
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+/**
+ * @brief This module implements the optional binary protocol that replaces the ASCII line protocol once negotiated.
+ * A frame consists of a message type byte, a fixed-layout payload and a CRC16 (CRC-16/MCRF4XX, little endian).
+ * The whole frame is COBS encoded and terminated by a 0x00 byte, meaning 0x00 never appears inside a frame.
+ * All multi-byte payload fields are little endian, the native byte order of the ATmega2560.
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * @brief Enum defining the message types of the binary protocol.
+ * The values are part of the protocol and must match Pi/serial_protocol.py.
+ */
+typedef enum {
+  MSG_COMMAND = 0x01, /**< Pi -> MBot, payload: uint8 sequence, uint8 command (messageRecieved_t), command arguments */
+  MSG_ACK = 0x02, /**< MBot -> Pi, payload: uint8 sequence, cumulative, all commands up to it were handled */
+  MSG_NOK = 0x03, /**< MBot -> Pi, payload: uint8 sequence, uint8 command that was rejected */
+  MSG_TEMPERATURE = 0x10, /**< MBot -> Pi, payload: int16 temperature */
+  MSG_ENCODERS = 0x11, /**< MBot -> Pi, payload: int32 encoder 1 pulses, int32 encoder 2 pulses */
+  MSG_GYRO = 0x12, /**< MBot -> Pi, payload: int16 yaw in centidegrees */
+  MSG_POSE = 0x13, /**< MBot -> Pi, payload: poseReport_t, int16 x mm, y mm, heading in centidegrees, uint32 time in ms, uint16 standard deviations of x, y in mm and heading in centidegrees, int8 correlations xy, x heading, y heading times 127 */
+  MSG_LOOP_STATS = 0x14, /**< MBot -> Pi, payload: uint16 loops per second, uint16 longest loop in microseconds, uint16 task and control step overruns */
+  MSG_SERIAL_DIAGNOSTICS = 0x15, /**< MBot -> Pi, payload: uint16 overruns, framing errors, rx buffer overflows, rx high-water mark, tx high-water mark, dropped tx messages, frame errors */
+  MSG_PROFILE = 0x16, /**< MBot -> Pi, payload: profileReport_t, uint8 section, uint16 samples, min, max, mean in microseconds, uint16 histogram buckets */
+  MSG_AUTOTUNE_SAMPLE = 0x17, /**< MBot -> Pi, payload: uint8 encoder, uint16 index, autotuneSample_t (uint16 timer ticks, int16 PWM, int16 pulses) */
+  MSG_AUTOTUNE_RESULT = 0x18, /**< MBot -> Pi, payload: autotuneResult_t, uint8 encoder, uint8 status, int16 steady speed, uint16 dead time, time constant, int16 kp, ki, feedforward times 1000 */
+  MSG_CALIBRATION_RESULT = 0x19, /**< MBot -> Pi, payload: calibrationResult_t, uint8 status, uint16 pulse lengths in 10 nm, uint16 track width in 0.1 mm, int16 rotation in 0.1 degrees, int16 heading drift in centidegrees */
+  MSG_PWM_SPEED_TABLE = 0x1A, /**< MBot -> Pi, payload: pwmSpeedTableReport_t, uint8 encoder, int8 direction, int16 speed in mm/s at every PWM level */
+  MSG_POSE_HISTORY = 0x1B /**< MBot -> Pi, payload: uint8 poseQueryStatus_t, poseReport_t at the asked time */
+} messageType_t;
+
+/**
+ * @brief Feeds one received byte to the frame decoder.
+ * @param b The byte read from the serial bus.
+ * @return True if a complete frame with a valid CRC has been decoded, otherwise false.
+ */
+bool parseFrameByte(uint8_t b);
+
+/**
+ * @brief Retrieves the message type of the last decoded frame.
+ * @return The message type.
+ */
+uint8_t getFrameType();
+
+/**
+ * @brief Retrieves the payload of the last decoded frame.
+ * @return Pointer to the payload bytes.
+ */
+const uint8_t *getFramePayload();
+
+/**
+ * @brief Retrieves the payload length of the last decoded frame.
+ * @return The payload length in bytes.
+ */
+uint8_t getFramePayloadLength();
+
+/**
+ * @brief Retrieves the number of frames dropped due to a bad CRC, bad COBS encoding or overflow.
+ * @return The number of dropped frames.
+ */
+unsigned int getFrameErrorCount();
+
+/**
+ * @brief Discards any partially received frame.
+ */
+void resetFrameParser();
+
+/**
+ * @brief Encodes a frame and queues it for transmission without waiting, the frame is dropped if the transmit buffer is full.
+ * @param type The message type.
+ * @param payload The payload bytes, may be NULL if length is 0.
+ * @param length The payload length, at most PROTOCOL_MAX_PAYLOAD_SIZE.
+ * @param reserveBytes Free space that must be left in the transmit buffer after the frame, it is held back otherwise.
+ * @return True if the frame was queued.
+ */
+bool sendFrame(uint8_t type, const void *payload, uint8_t length, uint8_t reserveBytes = 0);
+
+/**
+ * @brief COBS encodes a buffer.
+ * @param input The bytes to encode.
+ * @param length Number of bytes to encode.
+ * @param output Buffer of at least length + length / 254 + 1 bytes.
+ * @return Number of encoded bytes written to output.
+ */
+uint8_t cobsEncode(const uint8_t *input, uint8_t length, uint8_t *output);
+
+/**
+ * @brief COBS decodes a buffer, decoding in place (output == input) is allowed.
+ * @param input The encoded bytes, without the 0x00 delimiter.
+ * @param length Number of encoded bytes.
+ * @param output Buffer of at least length bytes.
+ * @return Number of decoded bytes, or 0 if the encoding is invalid.
+ */
+uint8_t cobsDecode(const uint8_t *input, uint8_t length, uint8_t *output);
+
+/**
+ * @brief Calculates the CRC16 (CRC-16/MCRF4XX) of a buffer.
+ * @param data The bytes to calculate the CRC of.
+ * @param length Number of bytes.
+ * @return The CRC16 value.
+ */
+uint16_t calculateCRC16(const uint8_t *data, uint8_t length);
+
+#endif // PROTOCOL_H
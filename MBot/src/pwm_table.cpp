@@ -0,0 +1,170 @@
+#include "config.h"
+#include "pwm_table.h"
+#include "encoder.h"
+#include "speed_control.h"
+#include "stored_settings.h"
+#include "current_state.h"
+#include "serial.h"
+
+typedef enum {
+  PWM_SWEEP_IDLE,
+  PWM_SWEEP_SETTLING,
+  PWM_SWEEP_MEASURING,
+  PWM_SWEEP_SENDING
+} pwmSweepState_t;
+
+pwmSweepState_t pwmSweepState = PWM_SWEEP_IDLE;
+int8_t pwmSweepDirection = 1;
+uint8_t pwmSweepLevel = 1;
+unsigned long pwmSweepTimeAtLevel = 0;
+encoderSnapshot_t pwmSweepStart;
+
+//Encoder and direction of the next table to send, encoder 1 forward, encoder 1 reverse, encoder 2 forward, encoder 2 reverse
+uint8_t nextPwmSpeedTableToSend = 0;
+
+static int16_t getPwmLevel(uint8_t level){
+  return (long)level * MAX_MOTOR_SPEED / (PWM_SPEED_TABLE_SIZE - 1);
+}
+
+static int16_t *getPwmSpeedTable(uint8_t encoderNumber, int8_t direction){
+  return getStoredSettings()->pwmSpeedTable[encoderNumber - 1][direction > 0 ? 0 : 1];
+}
+
+bool isPwmSpeedTableValid(){
+  return getStoredSettings()->pwmSpeedTableValid == 1;
+}
+
+/*
+ * The speeds never decrease with the level and the speed at level 0 is 0, so the first level at least as fast as the
+ * speed is always above a slower one. Inside the deadband the levels measure 0, which puts small speeds just above
+ * the last level that did not move the wheel.
+ */
+int16_t getPwmForSpeed(uint8_t encoderNumber, float speed){
+  if(speed == 0){
+    return 0;
+  }
+  const int16_t *table = getPwmSpeedTable(encoderNumber, speed > 0 ? 1 : -1);
+  float magnitude = fabs(speed);
+
+  int16_t pwm = MAX_MOTOR_SPEED;
+  for(uint8_t level = 1; level < PWM_SPEED_TABLE_SIZE; level++){
+    if(magnitude <= table[level]){
+      float fraction = (magnitude - table[level - 1]) / (table[level] - table[level - 1]);
+      pwm = getPwmLevel(level - 1) + fraction * (getPwmLevel(level) - getPwmLevel(level - 1));
+      break;
+    }
+  }
+  return speed > 0 ? pwm : -pwm;
+}
+
+int16_t linearizePwm(uint8_t encoderNumber, int16_t pwmValue){
+  if(!isPwmSpeedTableValid() || pwmValue == 0){
+    return pwmValue;
+  }
+  int8_t direction = pwmValue > 0 ? 1 : -1;
+  int16_t fullSpeed = min(getPwmSpeedTable(1, direction)[PWM_SPEED_TABLE_SIZE - 1], getPwmSpeedTable(2, direction)[PWM_SPEED_TABLE_SIZE - 1]);
+  return getPwmForSpeed(encoderNumber, (float)pwmValue * fullSpeed / MAX_MOTOR_SPEED);
+}
+
+static void startPwmSweepLevel(){
+  int16_t pwm = pwmSweepDirection * getPwmLevel(pwmSweepLevel);
+  setWheelPwmTargets(pwm, pwm);
+  pwmSweepTimeAtLevel = millis();
+  pwmSweepState = PWM_SWEEP_SETTLING;
+}
+
+//Stored along the PWM direction, a level slower than the one below it (noise at standstill) gets the speed of that one
+static void storePwmSweepSpeed(uint8_t encoderNumber, float speed){
+  int16_t *table = getPwmSpeedTable(encoderNumber, pwmSweepDirection);
+  float magnitude = speed * pwmSweepDirection;
+  table[pwmSweepLevel] = max(magnitude, (float)table[pwmSweepLevel - 1]);
+}
+
+//A wheel that never moved in a direction, or moved against its PWM, would make every speed map to full PWM
+static bool isPwmSweepComplete(){
+  for(uint8_t encoderNumber = 1; encoderNumber <= 2; encoderNumber++){
+    if(getPwmSpeedTable(encoderNumber, 1)[PWM_SPEED_TABLE_SIZE - 1] <= 0 || getPwmSpeedTable(encoderNumber, -1)[PWM_SPEED_TABLE_SIZE - 1] <= 0){
+      return false;
+    }
+  }
+  return true;
+}
+
+//A sweep that was left for standby is simply started over, the table is not used while it is being measured
+bool startPwmSweep(){
+  if(getCurrentState() != STANDBY){
+    return false;
+  }
+  setCurrentState(PWM_SWEEP);
+  getStoredSettings()->pwmSpeedTableValid = 0;
+  for(uint8_t encoderNumber = 1; encoderNumber <= 2; encoderNumber++){
+    getPwmSpeedTable(encoderNumber, 1)[0] = 0;
+    getPwmSpeedTable(encoderNumber, -1)[0] = 0;
+  }
+  pwmSweepDirection = 1;
+  pwmSweepLevel = 1;
+  startPwmSweepLevel();
+  return true;
+}
+
+void doPwmSweepTick(){
+  switch(pwmSweepState){
+    case(PWM_SWEEP_IDLE):
+      setCurrentState(STANDBY);
+      break;
+
+    case(PWM_SWEEP_SETTLING):
+      if(millis() - pwmSweepTimeAtLevel >= PWM_SWEEP_SETTLE_MS){
+        getEncoderSnapshot(&pwmSweepStart);
+        pwmSweepState = PWM_SWEEP_MEASURING;
+      }
+      break;
+
+    //Counted over the whole measuring time, which is more exact than the speed estimate of the control step
+    case(PWM_SWEEP_MEASURING):{
+      encoderSnapshot_t snapshot;
+      getEncoderSnapshot(&snapshot);
+      unsigned long elapsedMicros = snapshot.timeMicros - pwmSweepStart.timeMicros;
+      if(elapsedMicros < PWM_SWEEP_MEASURE_MS * 1000UL){
+        break;
+      }
+      float seconds = elapsedMicros * 1e-6;
+      storePwmSweepSpeed(1, (snapshot.encoder1Pulses - pwmSweepStart.encoder1Pulses) * getEncoderMillimeterPerCount(1) / seconds);
+      storePwmSweepSpeed(2, (snapshot.encoder2Pulses - pwmSweepStart.encoder2Pulses) * getEncoderMillimeterPerCount(2) / seconds);
+
+      if(++pwmSweepLevel < PWM_SPEED_TABLE_SIZE){
+        startPwmSweepLevel();
+      }
+      else if(pwmSweepDirection == 1){
+        pwmSweepDirection = -1;
+        pwmSweepLevel = 1;
+        startPwmSweepLevel();
+      }
+      else{
+        setWheelSpeedTargets(0, 0);
+        getStoredSettings()->pwmSpeedTableValid = isPwmSweepComplete() ? 1 : 0;
+        saveStoredSettings();
+        nextPwmSpeedTableToSend = 0;
+        pwmSweepState = PWM_SWEEP_SENDING;
+      }
+      break;
+    }
+
+    //One table per tick, like the profile
+    case(PWM_SWEEP_SENDING):{
+      pwmSpeedTableReport_t report;
+      report.encoderNumber = nextPwmSpeedTableToSend / 2 + 1;
+      report.direction = nextPwmSpeedTableToSend % 2 == 0 ? 1 : -1;
+      memcpy(report.speeds, getPwmSpeedTable(report.encoderNumber, report.direction), sizeof(report.speeds));
+      if(!sendPwmSpeedTableTransmission(&report)){
+        break;
+      }
+
+      if(++nextPwmSpeedTableToSend >= 4){
+        pwmSweepState = PWM_SWEEP_IDLE;
+        setCurrentState(STANDBY);
+      }
+      break;
+    }
+  }
+}
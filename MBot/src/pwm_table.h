@@ -0,0 +1,66 @@
+/**
+ * @file pwm_table.h
+ * @brief Header file containing the measured relation between motor PWM and wheel speed.
+ */
+
+#ifndef PWM_TABLE_H
+#define PWM_TABLE_H
+
+/**
+ * @brief This module measures the speed of each wheel at PWM_SPEED_TABLE_SIZE evenly spaced PWM levels in both
+ * directions, and inverts that table to find the PWM for a speed. The motors do not move below a certain PWM and are
+ * not linear above it, so with the table a small speed gets a PWM just above the deadband instead of one that does not
+ * move the wheel at all. The table is stored in EEPROM, until it is measured the linear feedforward of the speed
+ * control is used.
+ *
+ * The Pi starts the sweep with "sweep" in standby, the robot is in the PWM_SWEEP state until it is done and should be
+ * lifted so the wheels run freely.
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * @brief Struct holding the measured speeds of one wheel in one direction, sent as is in the binary protocol.
+ */
+typedef struct __attribute__((packed)) {
+  uint8_t encoderNumber; /**< The encoder of the wheel, 1 or 2 */
+  int8_t direction; /**< 1 for positive PWM, -1 for negative PWM */
+  int16_t speeds[PWM_SPEED_TABLE_SIZE]; /**< Speed in mm/s at every PWM level, never decreasing */
+} pwmSpeedTableReport_t;
+
+/**
+ * @brief Checks if a measured table is available.
+ * @return True if the PWM sweep has stored a table.
+ */
+bool isPwmSpeedTableValid();
+
+/**
+ * @brief Looks up the PWM that makes a wheel run at a speed, by linear interpolation between the measured levels.
+ * @param encoderNumber The encoder of the wheel, 1 or 2.
+ * @param speed The speed in mm/s, with the sign of the pulse count.
+ * @return The PWM, -255 to 255, saturated for speeds above the fastest measured one.
+ */
+int16_t getPwmForSpeed(uint8_t encoderNumber, float speed);
+
+/**
+ * @brief Converts an open loop PWM value into the PWM that gives the same fraction of the speed that both wheels reach at
+ * full PWM, so open loop speeds are linear and both wheels run equally fast. Returns the value unchanged without a table.
+ * @param encoderNumber The encoder of the wheel, 1 or 2.
+ * @param pwmValue The linear PWM value, -255 to 255.
+ * @return The PWM to apply.
+ */
+int16_t linearizePwm(uint8_t encoderNumber, int16_t pwmValue);
+
+/**
+ * @brief Starts the PWM sweep, only possible in standby.
+ * @return True if the sweep was started.
+ */
+bool startPwmSweep();
+
+/**
+ * @brief Performs a tick of the PWM sweep, run by the motor control task in the PWM_SWEEP state.
+ */
+void doPwmSweepTick();
+
+#endif // PWM_TABLE_H
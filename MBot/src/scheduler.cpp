@@ -0,0 +1,86 @@
+#include "config.h"
+#include "scheduler.h"
+#include "profiler.h"
+
+typedef struct {
+  taskFunction_t function;
+  unsigned long periodMicros;
+  unsigned long timeForNextRun;
+  uint16_t overruns;
+  unsigned long maxRunTimeMicros;
+} task_t;
+
+task_t tasks[SCHEDULER_MAX_TASKS];
+uint8_t numberOfTasks = 0;
+
+int8_t addTask(taskFunction_t function, unsigned long periodMicros){
+  if(numberOfTasks >= SCHEDULER_MAX_TASKS){
+    return -1;
+  }
+
+  task_t *task = &tasks[numberOfTasks];
+  task->function = function;
+  task->periodMicros = periodMicros;
+  task->timeForNextRun = micros();
+  task->overruns = 0;
+  task->maxRunTimeMicros = 0;
+  return numberOfTasks++;
+}
+
+/*
+ * A periodic task is released at timeForNextRun and has until the next release (its deadline) to start.
+ * Starting in time moves the release one period forward, which keeps the rate exact even if single runs start late.
+ * Starting after the deadline counts an overrun and restarts the schedule from now, otherwise the task would run
+ * back to back to catch up and delay every other task.
+ */
+void runScheduler(){
+  for(uint8_t i = 0; i < numberOfTasks; i++){
+    task_t *task = &tasks[i];
+    unsigned long timeAtStart = micros();
+
+    if(task->periodMicros != 0){
+      unsigned long timeSinceRelease = timeAtStart - task->timeForNextRun;
+      if((long)timeSinceRelease < 0){
+        continue;
+      }
+      PROFILE_SAMPLE(PROFILE_TASK_LATENESS, timeSinceRelease);
+
+      if(timeSinceRelease >= task->periodMicros){
+        task->overruns++;
+        task->timeForNextRun = timeAtStart + task->periodMicros;
+      }
+      else{
+        task->timeForNextRun += task->periodMicros;
+      }
+    }
+
+    task->function();
+
+    unsigned long runTime = micros() - timeAtStart;
+    if(runTime > task->maxRunTimeMicros){
+      task->maxRunTimeMicros = runTime;
+    }
+  }
+}
+
+uint16_t getTaskOverruns(uint8_t task){
+  if(task >= numberOfTasks){
+    return 0;
+  }
+  return tasks[task].overruns;
+}
+
+uint16_t getTotalTaskOverruns(){
+  uint16_t totalOverruns = 0;
+  for(uint8_t i = 0; i < numberOfTasks; i++){
+    totalOverruns += tasks[i].overruns;
+  }
+  return totalOverruns;
+}
+
+unsigned long getTaskMaxRunTimeMicros(uint8_t task){
+  if(task >= numberOfTasks){
+    return 0;
+  }
+  return tasks[task].maxRunTimeMicros;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file scheduler.h
+ * @brief Header file containing the fixed-rate cooperative task scheduler run from the main loop.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/**
+ * @brief This module runs registered tasks at fixed rates instead of once per main loop iteration.
+ * Each task has a period in microseconds; its deadline is the start of its next period.
+ * A task that cannot start before its deadline counts as an overrun and its schedule is realigned, so missed periods are
+ * skipped instead of run back to back. A period of 0 runs the task on every pass, for tasks that schedule themselves.
+ * Tasks run in the order they were added, which is also their priority.
+ */
+
+#include <Arduino.h>
+
+/**
+ * @brief Function run by a task.
+ */
+typedef void (*taskFunction_t)();
+
+/**
+ * @brief Adds a task to the scheduler.
+ * @param function The function to run.
+ * @param periodMicros Period in microseconds, 0 runs the task on every pass.
+ * @return The task number, or -1 if SCHEDULER_MAX_TASKS tasks are already added.
+ */
+int8_t addTask(taskFunction_t function, unsigned long periodMicros);
+
+/**
+ * @brief Runs every task that is due once. Call from the main loop.
+ */
+void runScheduler();
+
+/**
+ * @brief Retrieves the number of overruns of a task.
+ * @param task The task number returned by addTask().
+ * @return Number of times the task started after its deadline.
+ */
+uint16_t getTaskOverruns(uint8_t task);
+
+/**
+ * @brief Retrieves the number of overruns of all tasks together.
+ * @return Number of overruns.
+ */
+uint16_t getTotalTaskOverruns();
+
+/**
+ * @brief Retrieves the longest run time of a task.
+ * @param task The task number returned by addTask().
+ * @return The longest run time in microseconds.
+ */
+unsigned long getTaskMaxRunTimeMicros(uint8_t task);
+
+#endif // SCHEDULER_H
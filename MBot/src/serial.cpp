@@ -1,26 +1,45 @@
+#include <stdarg.h>
 #include "serial.h"
+#include "protocol.h"
 #include "localization.h"
 #include "encoder.h"
 #include "motorcontrol.h"
 #include "current_state.h"
 #include "led.h"
-#include "temperature.h"
+#include "gyro.h"
+#include "telemetry.h"
+#include "uart.h"
+#include "profiler.h"
+#include "testing_code.h"
 
-// Global variables used to store the latest messages received, time when the robot last got updated, and how many missed messages we have missed
-String recievedMessage;
+// Global variables used to store the time when the robot last got updated, and how many missed messages we have missed
 long timeAtLastSerialUpdate;
 int numberOfTicksMissed = 0;
-int numberOfTicksSinceTemperatureTransmission = 0;
+bool serialDataRecievedSinceLastTick = false;
+
+// Fixed buffer the incoming command is assembled in, one byte at a time (no String/heap usage)
+char recievedMessage[SERIAL_COMMAND_BUFFER_SIZE];
+uint8_t recievedMessageLength = 0;
+serialParserState_t serialParserState = READING_COMMAND;
+
+// The link always starts as ASCII lines, the Pi may switch it to binary frames with "hello:b"
+// and it falls back to ASCII after SERIAL_BINARY_LINK_TIMEOUT_MS without a valid frame
+serialLinkMode_t serialLinkMode = ASCII_LINK;
+
+// Binary commands carry a sequence number, only the next one in order is executed and acks are cumulative
+uint8_t expectedCommandSequence = 0;
+bool cumulativeAckPending = false;
+unsigned long timeAtLastValidFrame = 0;
 
 //Initiate serial communication
 void setupSerial(){
-  Serial.begin(57600); //Changed from 115200 due to unstable connection between Arduino and Pi
+  PiSerial.begin(57600); //Changed from 115200 due to unstable connection between Arduino and Pi
 }
 
 /*
  * This is the main function of the serial comunication.
- * When called, it updates what the serial monitor recieves periodically.
- * The update frequency can be changed in config.h.
+ * When called, it consumes whatever the serial monitor has recieved since the last call.
+ * Missed messages are counted periodically, the update frequency can be changed in config.h.
  * 
  * If alot of messages are missed, then change to stanby state.
  * This ensures that the robot does not move when it does not recieve any commands.
@@ -31,96 +50,433 @@ void setupSerial(){
  * It can definatly be developed in a better way, but it works for now according to our designed protocol.
  */
 void doSerialTick(){
+  PROFILE_START(PROFILE_SERIAL);
+  readSerialData();
+
+  //A Pi that restarted in ASCII mode never sends a frame again, so a silent binary link falls back to ASCII lines
+  if(getSerialLinkMode() == BINARY_LINK && millis() - timeAtLastValidFrame > SERIAL_BINARY_LINK_TIMEOUT_MS){
+    setSerialLinkMode(ASCII_LINK);
+  }
+
   if(millis() - timeAtLastSerialUpdate > SERIAL_UPDATE_FREQUENCY_MS){
     timeAtLastSerialUpdate = millis();
-    
-    readSerialData();
-    
-    clearStoredMessages();
+
+    if(serialDataRecievedSinceLastTick){
+      numberOfTicksMissed = 0;
+    }
+    else{
+      numberOfTicksMissed++;
+    }
+    serialDataRecievedSinceLastTick = false;
   }
 
   if(numberOfTicksMissed >= MAX_ALLOWED_MISSED_SERIAL_TICKS){
     setCurrentDirection(NONE);
   }
+  PROFILE_END(PROFILE_SERIAL);
+}
 
-  numberOfTicksSinceTemperatureTransmission += 1;
-  if(numberOfTicksSinceTemperatureTransmission >= NUMBER_OF_TICKS_BETWEEN_TEMPERATURE_TRANSMISSION){
-    numberOfTicksSinceTemperatureTransmission = 0;
-    sendTemperatureTransmission(getCurrentTemperature());
+/*
+ * The following functions send the telemetry streams scheduled in telemetry.cpp.
+ * Each is sent as a fixed-layout frame on a binary link or as a short "<id>:<values>" line on an ASCII link.
+ */
+void sendTemperatureTransmission(int currentTemperature){
+  if(getSerialLinkMode() == BINARY_LINK){
+    int16_t temperature = currentTemperature;
+    sendFrame(MSG_TEMPERATURE, &temperature, sizeof(temperature));
+    return;
   }
+
+  sendSerialLine("t:%d", currentTemperature);
 }
 
-void sendTemperatureTransmission(int currentTemperature){
-  String temperatureMessage = "t:" + String(currentTemperature);
-  temperatureMessage.trim();
-  Serial.println(temperatureMessage);
+void sendEncoderTransmission(){
+  encoderSnapshot_t snapshot;
+  getEncoderSnapshot(&snapshot);
+  int32_t encoderPulses[2] = {snapshot.encoder1Pulses, snapshot.encoder2Pulses};
+  if(getSerialLinkMode() == BINARY_LINK){
+    sendFrame(MSG_ENCODERS, encoderPulses, sizeof(encoderPulses));
+    return;
+  }
+
+  sendSerialLine("e:%ld,%ld", (long)encoderPulses[0], (long)encoderPulses[1]);
 }
 
-////As long as there are data available on the serial bus, read and store it, then acknowelge it to the Pi
-void readSerialData(){
-  if(Serial.available() > 0){
-    numberOfTicksMissed = 0;
-    
-    recievedMessage = readSerialBus();
+void sendGyroTransmission(){
+  int16_t yawCentidegrees = getGyroZ() * 100;
+  if(getSerialLinkMode() == BINARY_LINK){
+    sendFrame(MSG_GYRO, &yawCentidegrees, sizeof(yawCentidegrees));
+    return;
+  }
 
-    setSerialDataRecieved(recievedMessage);
+  sendSerialLine("g:%d", yawCentidegrees);
+}
 
-    ackMessage(getSerialDataRecieved());
+//Coordinates in millimeters and heading in centidegrees, followed by the time and the covariance of the odometry step
+void sendSerialCoordinates(){
+  poseReport_t report;
+  getPoseReport(&report);
+  if(getSerialLinkMode() == BINARY_LINK){
+    sendFrame(MSG_POSE, &report, sizeof(poseReport_t));
+    return;
+  }
+
+  sendSerialLine("p:%d,%d,%d,%lu,%u,%u,%u,%d,%d,%d", report.x, report.y, report.headingCentidegrees, (unsigned long)report.timeMillis,
+                 report.deviationX, report.deviationY, report.deviationHeadingCentidegrees, report.correlationXY,
+                 report.correlationXHeading, report.correlationYHeading);
+}
 
-    Serial.flush();
-    
+void sendLoopStatsTransmission(uint16_t loopsPerSecond, uint16_t maxLoopTimeMicros, uint16_t taskOverruns){
+  uint16_t loopStats[3] = {loopsPerSecond, maxLoopTimeMicros, taskOverruns};
+  if(getSerialLinkMode() == BINARY_LINK){
+    sendFrame(MSG_LOOP_STATS, loopStats, sizeof(loopStats));
+    return;
   }
-  else{
-    numberOfTicksMissed++;
+
+  sendSerialLine("ls:%u,%u,%u", loopStats[0], loopStats[1], loopStats[2]);
+}
+
+void sendSerialDiagnostics(){
+  uartStatistics_t statistics = PiSerial.getStatistics();
+  uint16_t diagnostics[7] = {statistics.rxOverruns, statistics.rxFramingErrors, statistics.rxBufferOverflows,
+                             statistics.rxHighWaterMark, statistics.txHighWaterMark, statistics.txDroppedMessages,
+                             (uint16_t)getFrameErrorCount()};
+  if(getSerialLinkMode() == BINARY_LINK){
+    sendFrame(MSG_SERIAL_DIAGNOSTICS, diagnostics, sizeof(diagnostics));
+    return;
+  }
+
+  sendSerialLine("u:%u,%u,%u,%u,%u,%u,%u", diagnostics[0], diagnostics[1], diagnostics[2], diagnostics[3],
+                 diagnostics[4], diagnostics[5], diagnostics[6]);
+}
+
+static_assert(PROFILE_HISTOGRAM_BUCKETS == 10, "The pf: line below lists 10 histogram buckets");
+
+bool sendProfileTransmission(const profileReport_t *report){
+  if(getSerialLinkMode() == BINARY_LINK){
+    return sendFrame(MSG_PROFILE, report, sizeof(profileReport_t), TELEMETRY_TX_RESERVE_BYTES);
+  }
+
+  return sendSerialLineWithReserve(TELEMETRY_TX_RESERVE_BYTES, "pf:%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u",
+                                   report->section, report->samples, report->minMicros, report->maxMicros,
+                                   report->meanMicros, report->histogram[0], report->histogram[1],
+                                   report->histogram[2], report->histogram[3], report->histogram[4],
+                                   report->histogram[5], report->histogram[6], report->histogram[7],
+                                   report->histogram[8], report->histogram[9]);
+}
+
+bool sendAutotuneSampleTransmission(uint8_t encoderNumber, uint16_t index, const autotuneSample_t *sample){
+  if(getSerialLinkMode() == BINARY_LINK){
+    uint8_t payload[3 + sizeof(autotuneSample_t)];
+    payload[0] = encoderNumber;
+    payload[1] = index;
+    payload[2] = index >> 8;
+    memcpy(payload + 3, sample, sizeof(autotuneSample_t));
+    return sendFrame(MSG_AUTOTUNE_SAMPLE, payload, sizeof(payload), TELEMETRY_TX_RESERVE_BYTES);
+  }
+
+  return sendSerialLineWithReserve(TELEMETRY_TX_RESERVE_BYTES, "at:%u,%u,%u,%d,%d",
+                                   encoderNumber, index, sample->timerTicks, sample->pwm, sample->pulses);
+}
+
+bool sendAutotuneResultTransmission(const autotuneResult_t *result){
+  if(getSerialLinkMode() == BINARY_LINK){
+    return sendFrame(MSG_AUTOTUNE_RESULT, result, sizeof(autotuneResult_t), TELEMETRY_TX_RESERVE_BYTES);
+  }
+
+  return sendSerialLineWithReserve(TELEMETRY_TX_RESERVE_BYTES, "ar:%u,%u,%d,%u,%u,%d,%d,%d",
+                                   result->encoderNumber, result->status, result->steadySpeed, result->deadTimeMs,
+                                   result->timeConstantMs, result->kpMilli, result->kiMilli, result->feedforwardMilli);
+}
+
+void sendCalibrationResultTransmission(const calibrationResult_t *result){
+  if(getSerialLinkMode() == BINARY_LINK){
+    sendFrame(MSG_CALIBRATION_RESULT, result, sizeof(calibrationResult_t));
+    return;
+  }
+
+  sendSerialLine("cr:%u,%u,%u,%u,%d,%d", result->status, result->encoder1PulseLength, result->encoder2PulseLength,
+                 result->trackWidthTenthMm, result->rotationDecidegrees, result->headingDriftCentidegrees);
+}
+
+bool sendPwmSpeedTableTransmission(const pwmSpeedTableReport_t *report){
+  if(getSerialLinkMode() == BINARY_LINK){
+    return sendFrame(MSG_PWM_SPEED_TABLE, report, sizeof(pwmSpeedTableReport_t), TELEMETRY_TX_RESERVE_BYTES);
+  }
+
+  return sendSerialLineWithReserve(TELEMETRY_TX_RESERVE_BYTES, "pt:%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d",
+                                   report->encoderNumber, report->direction, report->speeds[0], report->speeds[1],
+                                   report->speeds[2], report->speeds[3], report->speeds[4], report->speeds[5],
+                                   report->speeds[6], report->speeds[7], report->speeds[8]);
+}
+
+void sendPoseHistoryTransmission(poseQueryStatus_t status, const poseReport_t *report){
+  if(getSerialLinkMode() == BINARY_LINK){
+    uint8_t payload[1 + sizeof(poseReport_t)];
+    payload[0] = status;
+    memcpy(&payload[1], report, sizeof(poseReport_t));
+    sendFrame(MSG_POSE_HISTORY, payload, sizeof(payload));
+    return;
+  }
+
+  sendSerialLine("ph:%u,%d,%d,%d,%lu,%u,%u,%u,%d,%d,%d", status, report->x, report->y, report->headingCentidegrees,
+                 (unsigned long)report->timeMillis, report->deviationX, report->deviationY,
+                 report->deviationHeadingCentidegrees, report->correlationXY, report->correlationXHeading,
+                 report->correlationYHeading);
+}
+
+/*
+ * Reads everything currently waiting in the UART and feeds it byte by byte to the parser of the current link mode.
+ * Every complete command found is acted upon and acknowledged directly, so several commands
+ * arriving in the same read window are handled one by one instead of being glued together.
+ */
+void readSerialData(){
+  if(PiSerial.available() > 0){
+    serialDataRecievedSinceLastTick = true;
+
+    while(PiSerial.available() > 0){
+      uint8_t recievedByte = PiSerial.read();
+
+      if(getSerialLinkMode() == BINARY_LINK){
+        if(parseFrameByte(recievedByte)){
+          handleRecievedFrame();
+        }
+      }
+      else if(parseSerialByte((char)recievedByte)){
+        ackMessage(getSerialDataRecieved());
+        clearStoredMessages();
+      }
+    }
+
+    //One ack covers every command handled in this read window
+    if(cumulativeAckPending){
+      sendCumulativeAck();
+    }
   }
 }
 
 //Simply adds "!" to a message if sucessful, "?" if not
-void ackMessage(String message){
-  if(!ackReviecedMessage()){
+void ackMessage(const char *message){
+  if(!ackReviecedMessage(convertMessageToInt(message))){
     sendMessageNOK(message);
   }
 }
 
-//As long as there are data to read, read it. Also, making sure that newline character is found
-String readSerialBus(){
-  String message;
-  bool EoLFound = false;
-  while (Serial.available() > 0) {
-    message += (char)Serial.read();
-    if(message.indexOf("\n") > 0){
-      EoLFound = true;
+/*
+ * Binary counterpart of ackMessage(), the command is a single byte so no string parsing is needed.
+ * Only the command with the expected sequence number is executed, go-back-N style: a duplicate (its ack got lost)
+ * or a command after a gap (an earlier one got lost) is dropped and answered with the cumulative ack so the Pi resends.
+ * Hello commands are always executed and restart the numbering, which lets the Pi resynchronize at connect.
+ * Pose queries are idempotent and sent outside the numbering, they are answered directly and neither acked nor
+ * refused, since a NOK carries a sequence number the Pi would match against its numbered commands.
+ */
+void handleRecievedFrame(){
+  timeAtLastValidFrame = millis();
+  if(getFrameType() != MSG_COMMAND || getFramePayloadLength() < 2){
+    return;
+  }
+
+  uint8_t sequence = getFramePayload()[0];
+  uint8_t command = getFramePayload()[1];
+  if(command == QueryPoseHistory){
+    ackReviecedMessage(QueryPoseHistory);
+    return;
+  }
+  cumulativeAckPending = true;
+
+  if(command == Hello || command == HelloBinary){
+    expectedCommandSequence = sequence;
+  }
+  else if(sequence != expectedCommandSequence){
+    return;
+  }
+  expectedCommandSequence++;
+
+  if(command >= Error || !ackReviecedMessage((messageRecieved_t)command)){
+    uint8_t nok[2] = {sequence, command};
+    sendFrame(MSG_NOK, nok, sizeof(nok));
+  }
+}
+
+/*
+ * Reads the time of a pose query.
+ * ASCII: "pq:<time ms>", binary: uint32 time after the sequence and command bytes.
+ */
+bool getPoseQueryArguments(uint32_t *timeMillis){
+  if(getSerialLinkMode() == BINARY_LINK){
+    if(getFramePayloadLength() != 6){
+      return false;
+    }
+    const uint8_t *arguments = getFramePayload() + 2;
+    *timeMillis = arguments[0] | ((uint32_t)arguments[1] << 8) | ((uint32_t)arguments[2] << 16) | ((uint32_t)arguments[3] << 24);
+    return true;
+  }
+
+  char *end;
+  const char *arguments = getSerialDataRecieved() + 3;
+  unsigned long parsedTime = strtoul(arguments, &end, 10);
+  if(end == arguments || *end != '\0'){
+    return false;
+  }
+  *timeMillis = parsedTime;
+  return true;
+}
+
+/*
+ * Reads the stream and period of a telemetry rate command.
+ * ASCII: "tr:<stream>,<period ms>", binary: uint8 stream, uint16 period after the sequence and command bytes.
+ */
+bool getTelemetryRateArguments(uint8_t *stream, uint16_t *periodMs){
+  if(getSerialLinkMode() == BINARY_LINK){
+    if(getFramePayloadLength() != 5){
+      return false;
     }
+    const uint8_t *arguments = getFramePayload() + 2;
+    *stream = arguments[0];
+    *periodMs = arguments[1] | ((uint16_t)arguments[2] << 8);
+    return true;
   }
-  if(EoLFound){
-    return message;
+
+  char *end;
+  const char *arguments = getSerialDataRecieved() + 3;
+  long parsedStream = strtol(arguments, &end, 10);
+  if(end == arguments || *end != ','){
+    return false;
+  }
+  arguments = end + 1;
+  long parsedPeriod = strtol(arguments, &end, 10);
+  if(end == arguments || *end != '\0' || parsedStream < 0 || parsedStream > 255 || parsedPeriod < 0 || parsedPeriod > 0xFFFF){
+    return false;
+  }
+  *stream = parsedStream;
+  *periodMs = parsedPeriod;
+  return true;
+}
+
+//Acknowledges an executed command in the format of the current link mode, binary acks are sent cumulatively after the read window
+void sendCommandAck(messageRecieved_t command){
+  if(getSerialLinkMode() == BINARY_LINK){
+    cumulativeAckPending = true;
   }
   else{
-    return "EoL Not found";
+    sendMessageAck(getSerialDataRecieved());
   }
 }
 
-void setSerialDataRecieved(String s_dataToStore){
-  recievedMessage = s_dataToStore;
+//Acks every binary command up to and including the last one executed in order
+void sendCumulativeAck(){
+  uint8_t lastSequenceInOrder = expectedCommandSequence - 1;
+  sendFrame(MSG_ACK, &lastSequenceInOrder, sizeof(lastSequenceInOrder));
+  cumulativeAckPending = false;
 }
 
-String getSerialDataRecieved(){
+serialLinkMode_t getSerialLinkMode(){
+  return serialLinkMode;
+}
+
+void setSerialLinkMode(serialLinkMode_t newLinkMode){
+  serialLinkMode = newLinkMode;
+  expectedCommandSequence = 0;
+  timeAtLastValidFrame = millis();
+  cumulativeAckPending = false;
+  resetFrameParser();
+  clearStoredMessages();
+}
+
+/*
+ * State machine assembling one command from the incoming bytes.
+ * Returns true when a complete (newline terminated) command is stored in the buffer.
+ * Leading/trailing whitespace and '\r' are dropped, empty lines are ignored.
+ * A command longer than the buffer is discarded up to its newline and then handed on truncated, which results in a "?".
+ */
+bool parseSerialByte(char c){
+  if(c == '\n'){
+    while(recievedMessageLength > 0 && isspace(recievedMessage[recievedMessageLength - 1])){
+      recievedMessageLength--;
+    }
+    recievedMessage[recievedMessageLength] = '\0';
+    serialParserState = READING_COMMAND;
+    return recievedMessageLength > 0;
+  }
+
+  if(serialParserState == DISCARDING_COMMAND || c == '\r' || (recievedMessageLength == 0 && isspace(c))){
+    return false;
+  }
+
+  if(recievedMessageLength < SERIAL_COMMAND_BUFFER_SIZE - 1){
+    recievedMessage[recievedMessageLength++] = c;
+  }
+  else{
+    serialParserState = DISCARDING_COMMAND;
+  }
+  return false;
+}
+
+const char *getSerialDataRecieved(){
   return recievedMessage;
 }
 
+/*
+ * Formats a line into a fixed buffer and queues it as a whole, the UART interrupt sends it while the main loop keeps running.
+ * If the transmit buffer is full the line is dropped (and counted) instead of waiting, the Pi resends unacked commands.
+ */
+static bool sendFormattedLine(uint8_t reserveBytes, const char *format, va_list arguments){
+  char line[SERIAL_LINE_BUFFER_SIZE];
+  int length = vsnprintf(line, sizeof(line) - 2, format, arguments);
+  if(length < 0){
+    return false;
+  }
+  if(length > (int)sizeof(line) - 3){
+    length = sizeof(line) - 3;
+  }
+
+  line[length++] = '\r';
+  line[length++] = '\n';
+  //Like frames, a line held back for the reserve is not counted as dropped
+  if(reserveBytes > 0 && PiSerial.availableForWrite() < length + reserveBytes){
+    return false;
+  }
+  return PiSerial.writeNonBlocking((const uint8_t *)line, length);
+}
+
+void sendSerialLine(const char *format, ...){
+  va_list arguments;
+  va_start(arguments, format);
+  sendFormattedLine(0, format, arguments);
+  va_end(arguments);
+}
+
+bool sendSerialLineWithReserve(uint8_t reserveBytes, const char *format, ...){
+  va_list arguments;
+  va_start(arguments, format);
+  bool sent = sendFormattedLine(reserveBytes, format, arguments);
+  va_end(arguments);
+  return sent;
+}
+
+//Text on the binary link would end up inside the next frame and break its CRC
+void sendDebugLine(const char *format, ...){
+  if(getSerialLinkMode() == BINARY_LINK){
+    return;
+  }
+  va_list arguments;
+  va_start(arguments, format);
+  sendFormattedLine(0, format, arguments);
+  va_end(arguments);
+}
+
 //Some specific "?", "C" and coorinate functions used often
-void sendMessageNOK(String message){
-  message.trim();
-  Serial.println(message + "?");
+void sendMessageNOK(const char *message){
+  sendSerialLine("%s?", message);
 }
 
-void sendMessageAck(String message){
-  message.trim();
-  Serial.println(message + "!");
+void sendMessageAck(const char *message){
+  sendSerialLine("%s!", message);
 }
 
 void clearStoredMessages(){
-  recievedMessage = "";
+  recievedMessageLength = 0;
+  recievedMessage[0] = '\0';
 }
 
 /*
@@ -128,101 +484,199 @@ void clearStoredMessages(){
  * This is done with the help of switch cases and some enums.
  * Depening on what message is recieved, the robot should act accordingly.
  */
-bool ackReviecedMessage(){
-  switch(convertMessageToInt(getSerialDataRecieved())){
+bool ackReviecedMessage(messageRecieved_t command){
+  switch(command){
     case(Hello):
-      sendMessageAck(getSerialDataRecieved());
+      sendCommandAck(command);
+      return true;
+    case(HelloBinary):
+      //Ack is still sent in the old link mode, everything after it is framed
+      sendCommandAck(command);
+      if(getSerialLinkMode() != BINARY_LINK){
+        setSerialLinkMode(BINARY_LINK);
+      }
       return true;
 
     case(Standby):
       setCurrentState(STANDBY);
-      sendMessageAck(getSerialDataRecieved());
-      //Reset map coordinates
-      resetCoordinates();
+      sendCommandAck(command);
+      //Reset map coordinates, after the encoders so the odometry starts from the new counts
       resetEncoderValues();
+      resetCoordinates();
       return true;
 
     case(ManualStop):
       setCurrentState(MANUAL);
       setCurrentDirection(NONE);
-      sendMessageAck(getSerialDataRecieved());
+      sendCommandAck(command);
       return true;
     case(ManualForward):
       setCurrentDirection(FORWARD);
-      sendMessageAck(getSerialDataRecieved());
+      sendCommandAck(command);
       return true;
     case(ManualBackward):
       setCurrentDirection(BACKWARD);
-      sendMessageAck(getSerialDataRecieved());
+      sendCommandAck(command);
       return true;
     case(ManualLeft):
       setCurrentDirection(LEFT);
-      sendMessageAck(getSerialDataRecieved());
+      sendCommandAck(command);
       return true;
     case(ManualRight):
       setCurrentDirection(RIGHT);
-      sendMessageAck(getSerialDataRecieved());
+      sendCommandAck(command);
       return true;
 
     case(SetManualMotorSpeedHigh):
       setMotorSpeedManualPercentage(MANUAL_MOTOR_SPEED_HIGH_PERCENTAGE);
-      sendMessageAck(getSerialDataRecieved());
-      activateAllLEDsRGB(100, 100, 100);
+      sendCommandAck(command);
+      activateFlashLEDs();
       return true;
     case(SetManualMotorSpeedMedium):
       setMotorSpeedManualPercentage(MANUAL_MOTOR_SPEED_MEDIUM_PERCENTAGE);
-      sendMessageAck(getSerialDataRecieved());
-      activateAllLEDsRGB(100, 100, 100);
+      sendCommandAck(command);
+      activateFlashLEDs();
       return true;
     case(SetManualMotorSpeedLow):
       setMotorSpeedManualPercentage(MANUAL_MOTOR_SPEED_LOW_PERCENTAGE);
-      sendMessageAck(getSerialDataRecieved());
-      activateAllLEDsRGB(100, 100, 100);
+      sendCommandAck(command);
+      activateFlashLEDs();
+      return true;
+
+    case(SetTelemetryRate):{
+      uint8_t stream;
+      uint16_t periodMs;
+      if(!getTelemetryRateArguments(&stream, &periodMs) || !setTelemetryPeriod(stream, periodMs)){
+        return false;
+      }
+      sendCommandAck(command);
+      return true;
+    }
+
+    case(RequestSerialDiagnostics):
+      sendCommandAck(command);
+      sendSerialDiagnostics();
+      return true;
+
+    case(RequestProfileReport):
+      sendCommandAck(command);
+      requestProfileReport();
+      return true;
+
+    case(StartAutotune):
+      if(!startAutotune()){
+        return false;
+      }
+      sendCommandAck(command);
       return true;
 
+    case(StartCalibration):
+      if(!startCalibration()){
+        return false;
+      }
+      sendCommandAck(command);
+      return true;
+
+    case(StartPwmSweep):
+      if(!startPwmSweep()){
+        return false;
+      }
+      sendCommandAck(command);
+      return true;
+
+    //Blocks for about a second and prints text lines, so it only runs in standby on the ASCII link
+    case(RunFixedPointBenchmark):
+      if(getSerialLinkMode() == BINARY_LINK || getCurrentState() != STANDBY){
+        return false;
+      }
+      sendCommandAck(command);
+      doFixedPointBenchmark();
+      return true;
+
+    case(QueryPoseHistory):{
+      uint32_t timeMillis;
+      if(!getPoseQueryArguments(&timeMillis)){
+        return false;
+      }
+      //Binary queries are outside the command numbering, the pose answers them
+      if(getSerialLinkMode() != BINARY_LINK){
+        sendCommandAck(command);
+      }
+      poseReport_t report;
+      poseQueryStatus_t status = getPoseAtTime(timeMillis, &report);
+      sendPoseHistoryTransmission(status, &report);
+      return true;
+    }
+
     case(Error):
       return false;
   }
   return false;
 }
 
-messageRecieved_t convertMessageToInt(String message){
-  message.trim();
-  
-  if(message.equals("hello")){
+messageRecieved_t convertMessageToInt(const char *message){
+  if(strcmp(message, "hello") == 0){
     return Hello;
   }
+  else if(strcmp(message, "hello:b") == 0){
+    return HelloBinary;
+  }
 
-  else if(message.equals("r")){ // R - Remain / Standby due to 'S' for backward
+  else if(strcmp(message, "r") == 0){ // R - Remain / Standby due to 'S' for backward
     return Standby;
   }
-  else if(message.equals("c")){
+  else if(strcmp(message, "c") == 0){
     return ManualStop;
   }
 
-  else if(message.equals("w")){
+  else if(strcmp(message, "w") == 0){
     return ManualForward;
   }
-  else if(message.equals("d")){
+  else if(strcmp(message, "d") == 0){
     return ManualRight;
   }
-  else if(message.equals("s")){
+  else if(strcmp(message, "s") == 0){
     return ManualBackward;
   }
-  else if(message.equals("a")){
+  else if(strcmp(message, "a") == 0){
     return ManualLeft;
   }
 
-  else if(message.equals("h")){
+  else if(strcmp(message, "h") == 0){
     return SetManualMotorSpeedHigh;
   }
-  else if(message.equals("m")){
+  else if(strcmp(message, "m") == 0){
     return SetManualMotorSpeedMedium;
   }
-  else if(message.equals("l")){
+  else if(strcmp(message, "l") == 0){
     return SetManualMotorSpeedLow;
   }
 
+  else if(strncmp(message, "tr:", 3) == 0){
+    return SetTelemetryRate;
+  }
+  else if(strcmp(message, "diag") == 0){
+    return RequestSerialDiagnostics;
+  }
+  else if(strcmp(message, "prof") == 0){
+    return RequestProfileReport;
+  }
+  else if(strcmp(message, "tune") == 0){
+    return StartAutotune;
+  }
+  else if(strcmp(message, "cal") == 0){
+    return StartCalibration;
+  }
+  else if(strcmp(message, "sweep") == 0){
+    return StartPwmSweep;
+  }
+  else if(strncmp(message, "pq:", 3) == 0){
+    return QueryPoseHistory;
+  }
+  else if(strcmp(message, "bench") == 0){
+    return RunFixedPointBenchmark;
+  }
+
   else
     return Error;
 }
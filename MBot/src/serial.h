@@ -11,12 +11,19 @@
  * It periodically reads the serial bus, stores received data, and performs appropriate actions based on the received data.
  */
 
+#include <Arduino.h>
 #include <ArduinoQueue.h>
 #include <WString.h>
 #include "config.h"
+#include "profiler.h"
+#include "autotune.h"
+#include "calibration.h"
+#include "pwm_table.h"
+#include "pose_history.h"
 
 /**
  * @brief Enum defining different types of messages received.
+ * The values are sent as command byte in the binary protocol, so new messages must be added last (before Error).
  */
 typedef enum {
   Hello, /**< Hello message received */
@@ -29,9 +36,34 @@ typedef enum {
   SetManualMotorSpeedHigh, /**< Set manual motor speed to high message received */
   SetManualMotorSpeedMedium, /**< Set manual motor speed to medium message received */
   SetManualMotorSpeedLow, /**< Set manual motor speed to low message received */
+  HelloBinary, /**< Hello message requesting the binary framed protocol received */
+  SetTelemetryRate, /**< Set the period of a telemetry stream message received */
+  RequestSerialDiagnostics, /**< Request for the serial port error counters received */
+  RequestProfileReport, /**< Request for the run time profile of the subsystems received */
+  StartAutotune, /**< Start of the wheel speed controller autotune received */
+  StartCalibration, /**< Start of the wheel geometry calibration received */
+  StartPwmSweep, /**< Start of the PWM to wheel speed sweep received */
+  QueryPoseHistory, /**< Request for the pose at a recent time received */
+  RunFixedPointBenchmark, /**< Request to measure the fixed point library against soft float received */
   Error /**< Error message received */
 } messageRecieved_t;
 
+/**
+ * @brief Enum defining the states of the incremental serial command parser.
+ */
+typedef enum {
+  READING_COMMAND, /**< Bytes are appended to the command buffer */
+  DISCARDING_COMMAND /**< Command did not fit in the buffer, bytes are dropped until newline */
+} serialParserState_t;
+
+/**
+ * @brief Enum defining the format used on the serial link.
+ */
+typedef enum {
+  ASCII_LINK, /**< Newline terminated text commands, acked with "!" or "?" */
+  BINARY_LINK /**< COBS framed binary messages with CRC16, see protocol.h */
+} serialLinkMode_t;
+
 /**
  * @brief Sets up the serial communication.
  */
@@ -43,13 +75,102 @@ void setupSerial();
  */
 void sendTemperatureTransmission(int currentTemperature);
 
+/**
+ * @brief Sends the pulse count of both encoders over serial.
+ */
+void sendEncoderTransmission();
+
+/**
+ * @brief Sends the gyro yaw over serial.
+ */
+void sendGyroTransmission();
+
+/**
+ * @brief Sends main loop statistics over serial.
+ * @param loopsPerSecond Main loop iterations during the last second.
+ * @param maxLoopTimeMicros Longest main loop iteration in microseconds.
+ * @param taskOverruns Number of scheduler task and wheel control step overruns since start.
+ */
+void sendLoopStatsTransmission(uint16_t loopsPerSecond, uint16_t maxLoopTimeMicros, uint16_t taskOverruns);
+
+/**
+ * @brief Formats a line and queues it for transmission without waiting, a line that does not fit in the transmit buffer is dropped.
+ * @param format printf style format of the line, the line ending is added.
+ * @param ... Values for the format.
+ */
+void sendSerialLine(const char *format, ...);
+
+/**
+ * @brief Formats a line like sendSerialLine, but holds it back unless it leaves reserveBytes free in the transmit buffer.
+ * @param reserveBytes Free space that must be left in the transmit buffer after the line.
+ * @param format printf style format of the line, the line ending is added.
+ * @param ... Values for the format.
+ * @return True if the line was queued.
+ */
+bool sendSerialLineWithReserve(uint8_t reserveBytes, const char *format, ...);
+
+/**
+ * @brief Formats a debug line like sendSerialLine, but only sends it on the ASCII link where it cannot corrupt a frame.
+ * @param format printf style format of the line, the line ending is added.
+ * @param ... Values for the format.
+ */
+void sendDebugLine(const char *format, ...);
+
+/**
+ * @brief Sends the serial port error and load counters over serial.
+ */
+void sendSerialDiagnostics();
+
+/**
+ * @brief Sends the run time profile of one section over serial.
+ * @param report The report of the section.
+ * @return True if it was queued, it is held back while it would cut into the TELEMETRY_TX_RESERVE_BYTES kept for acks.
+ */
+bool sendProfileTransmission(const profileReport_t *report);
+
+/**
+ * @brief Sends one sample of an autotune capture over serial.
+ * @param encoderNumber The encoder of the wheel being tuned.
+ * @param index The index of the sample in the capture.
+ * @param sample The sample.
+ * @return True if it was queued, it is held back while it would cut into the TELEMETRY_TX_RESERVE_BYTES kept for acks.
+ */
+bool sendAutotuneSampleTransmission(uint8_t encoderNumber, uint16_t index, const autotuneSample_t *sample);
+
+/**
+ * @brief Sends the autotune result of one wheel over serial.
+ * @param result The result.
+ * @return True if it was queued, it is held back while it would cut into the TELEMETRY_TX_RESERVE_BYTES kept for acks.
+ */
+bool sendAutotuneResultTransmission(const autotuneResult_t *result);
+
+/**
+ * @brief Sends the result of a wheel geometry calibration over serial.
+ * @param result The result.
+ */
+void sendCalibrationResultTransmission(const calibrationResult_t *result);
+
+/**
+ * @brief Sends the measured wheel speeds of one wheel and direction over serial.
+ * @param report The speed table.
+ * @return True if it was queued, it is held back while it would cut into the TELEMETRY_TX_RESERVE_BYTES kept for acks.
+ */
+bool sendPwmSpeedTableTransmission(const pwmSpeedTableReport_t *report);
+
+/**
+ * @brief Sends the answer to a pose query over serial.
+ * @param status The result of the query.
+ * @param report The pose at the asked time.
+ */
+void sendPoseHistoryTransmission(poseQueryStatus_t status, const poseReport_t *report);
+
 /**
  * @brief Performs a tick for serial communication operations.
  */
 void doSerialTick();
 
 /**
- * @brief Reads data from the serial bus.
+ * @brief Reads all data waiting on the serial bus and handles every complete command in it.
  */
 void readSerialData();
 
@@ -57,37 +178,75 @@ void readSerialData();
  * @brief Sends an acknowledgment message.
  * @param message The message to acknowledge.
  */
-void ackMessage(String message);
+void ackMessage(const char *message);
+
+/**
+ * @brief Handles a decoded binary frame, executing the command in it if its sequence number is the expected one.
+ */
+void handleRecievedFrame();
+
+/**
+ * @brief Acknowledges an executed command in the format of the current link mode.
+ * @param command The command that was executed.
+ */
+void sendCommandAck(messageRecieved_t command);
+
+/**
+ * @brief Reads the arguments of a telemetry rate command in the format of the current link mode.
+ * @param stream Set to the telemetry stream to change.
+ * @param periodMs Set to the new period in milliseconds.
+ * @return True if the arguments are valid, otherwise false.
+ */
+bool getTelemetryRateArguments(uint8_t *stream, uint16_t *periodMs);
+
+/**
+ * @brief Reads the argument of a pose query in the format of the current link mode.
+ * @param timeMillis Set to the asked time on the millis() clock.
+ * @return True if the argument is valid, otherwise false.
+ */
+bool getPoseQueryArguments(uint32_t *timeMillis);
+
+/**
+ * @brief Sends one binary ack covering all commands executed in order so far.
+ */
+void sendCumulativeAck();
+
+/**
+ * @brief Retrieves the format currently used on the serial link.
+ * @return The current link mode.
+ */
+serialLinkMode_t getSerialLinkMode();
 
 /**
- * @brief Reads data from the serial bus and returns it.
- * @return The data read from the serial bus.
+ * @brief Sets the format used on the serial link and discards any partially received data.
+ * @param newLinkMode The new link mode.
  */
-String readSerialBus();
+void setSerialLinkMode(serialLinkMode_t newLinkMode);
 
 /**
- * @brief Sets received serial data to store.
- * @param s_dataToStore The data to store.
+ * @brief Feeds one received byte to the incremental command parser.
+ * @param c The byte read from the serial bus.
+ * @return True if a complete command is now stored, otherwise false.
  */
-void setSerialDataRecieved(String s_dataToStore);
+bool parseSerialByte(char c);
 
 /**
  * @brief Retrieves the stored received serial data.
  * @return The stored received serial data.
  */
-String getSerialDataRecieved();
+const char *getSerialDataRecieved();
 
 /**
  * @brief Sends a message indicating failure.
  * @param message The failure message to send.
  */
-void sendMessageNOK(String message);
+void sendMessageNOK(const char *message);
 
 /**
  * @brief Sends an acknowledgment message.
  * @param message The acknowledgment message to send.
  */
-void sendMessageAck(String message);
+void sendMessageAck(const char *message);
 
 /**
  * @brief Sends a signal indicating the ultrasonic sensor was triggered.
@@ -95,7 +254,7 @@ void sendMessageAck(String message);
 void sendSerialUltraSonicTriggered();
 
 /**
- * @brief Sends coordinates over serial.
+ * @brief Sends the pose of the last odometry step with its time and covariance over serial.
  */
 void sendSerialCoordinates();
 
@@ -122,16 +281,17 @@ void clearStoredMessages();
 bool recievedCaptureAck();
 
 /**
- * @brief Checks if an acknowledgment was received for a message.
- * @return True if an acknowledgment was received, otherwise false.
+ * @brief Executes a received command and acknowledges it if it was valid.
+ * @param command The command to execute.
+ * @return True if the command was executed and acknowledged, otherwise false.
  */
-bool ackReviecedMessage();
+bool ackReviecedMessage(messageRecieved_t command);
 
 /**
  * @brief Converts a message string to its corresponding enum value.
  * @param message The message string to convert.
  * @return The corresponding enum value of the message.
  */
-messageRecieved_t convertMessageToInt(String message);
+messageRecieved_t convertMessageToInt(const char *message);
 
 #endif // SERIAL_COMMUNICATION_H
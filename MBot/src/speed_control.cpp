@@ -0,0 +1,127 @@
+#include <util/atomic.h>
+#include "config.h"
+#include "encoder.h"
+#include "speed_control.h"
+#include "stored_settings.h"
+#include "pwm_table.h"
+
+typedef struct {
+  float targetSpeed;
+  float integral;
+  int16_t fixedPwm;
+  wheelSpeedGains_t gains;
+} wheelController_t;
+
+wheelController_t encoder1Controller;
+wheelController_t encoder2Controller;
+
+volatile bool wheelSpeedControlActive = false;
+volatile bool wheelPwmFixed = false;
+unsigned long timeAtLastSpeedControlStep = 0;
+
+void setupSpeedControl(){
+  setWheelSpeedGains(1, &getStoredSettings()->wheelSpeedGains[0]);
+  setWheelSpeedGains(2, &getStoredSettings()->wheelSpeedGains[1]);
+}
+
+void setWheelSpeedGains(uint8_t encoderNumber, const wheelSpeedGains_t *gains){
+  wheelController_t *controller = encoderNumber == 1 ? &encoder1Controller : &encoder2Controller;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    controller->gains = *gains;
+    controller->integral = 0;
+  }
+}
+
+void setWheelSpeedTargets(float encoder1Speed, float encoder2Speed){
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    encoder1Controller.targetSpeed = encoder1Speed;
+    encoder2Controller.targetSpeed = encoder2Speed;
+    wheelSpeedControlActive = true;
+    wheelPwmFixed = false;
+  }
+}
+
+void setWheelPwmTargets(int16_t encoder1Pwm, int16_t encoder2Pwm){
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    encoder1Controller.fixedPwm = encoder1Pwm;
+    encoder2Controller.fixedPwm = encoder2Pwm;
+    encoder1Controller.integral = 0;
+    encoder2Controller.integral = 0;
+    wheelSpeedControlActive = true;
+    wheelPwmFixed = true;
+  }
+}
+
+void stopWheelSpeedControl(){
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    wheelSpeedControlActive = false;
+    encoder1Controller.integral = 0;
+    encoder2Controller.integral = 0;
+  }
+}
+
+bool isWheelSpeedControlActive(){
+  return wheelSpeedControlActive;
+}
+
+/*
+ * The feedforward gives the PWM a wheel needs for the target on a charged battery, from the measured PWM table when
+ * there is one, the PI part corrects for the battery level and the differences between the motors. A stopped wheel gets
+ * no PWM at all so it does not creep.
+ */
+static int16_t updateWheelController(uint8_t encoderNumber, wheelController_t *controller, float measuredSpeed, float stepSeconds){
+  float targetSpeed = controller->targetSpeed;
+  if(targetSpeed == 0){
+    controller->integral = 0;
+    return 0;
+  }
+
+  float error = targetSpeed - measuredSpeed;
+  float feedforward;
+  if(isPwmSpeedTableValid()){
+    feedforward = getPwmForSpeed(encoderNumber, targetSpeed);
+  }
+  else{
+    feedforward = targetSpeed * controller->gains.feedforwardPwmPerMmS;
+    feedforward += targetSpeed > 0 ? WHEEL_SPEED_FEEDFORWARD_STATIC_PWM : -WHEEL_SPEED_FEEDFORWARD_STATIC_PWM;
+  }
+  float integral = controller->integral + controller->gains.ki * error * stepSeconds;
+  float output = feedforward + controller->gains.kp * error + integral;
+
+  //Anti-windup, while saturated the integral only follows errors that bring the output back into range
+  if(output > MAX_MOTOR_SPEED){
+    output = MAX_MOTOR_SPEED;
+    if(error < 0){
+      controller->integral = integral;
+    }
+  }
+  else if(output < -MAX_MOTOR_SPEED){
+    output = -MAX_MOTOR_SPEED;
+    if(error > 0){
+      controller->integral = integral;
+    }
+  }
+  else{
+    controller->integral = integral;
+  }
+  return (int16_t)output;
+}
+
+//The step time is measured since the step also runs from the blocking moves when the control timer is not used
+void doWheelSpeedControlStep(){
+  unsigned long timeNow = micros();
+  float stepSeconds = (timeNow - timeAtLastSpeedControlStep) * 1e-6;
+  timeAtLastSpeedControlStep = timeNow;
+  if(stepSeconds > WHEEL_SPEED_TIMEOUT_MS * 1e-3){
+    stepSeconds = WHEEL_SPEED_TIMEOUT_MS * 1e-3;
+  }
+
+  if(wheelPwmFixed){
+    setEncoder1MotorPwm(encoder1Controller.fixedPwm);
+    setEncoder2MotorPwm(encoder2Controller.fixedPwm);
+    return;
+  }
+
+  setEncoder1MotorPwm(updateWheelController(1, &encoder1Controller, getEncoder1Speed(), stepSeconds));
+  setEncoder2MotorPwm(updateWheelController(2, &encoder2Controller, getEncoder2Speed(), stepSeconds));
+}
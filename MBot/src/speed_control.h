@@ -0,0 +1,74 @@
+/**
+ * @file speed_control.h
+ * @brief Header file containing the closed loop speed control of the wheels.
+ */
+
+#ifndef SPEED_CONTROL_H
+#define SPEED_CONTROL_H
+
+/**
+ * @brief This module regulates the speed of each wheel to a target in millimeters per second.
+ * Every wheel control step compares the target with the speed measured from the encoder edges and sets the motor PWM
+ * from a feedforward of the target plus a PI correction. The integral is held while the PWM is saturated, so it does not
+ * wind up when a wheel cannot keep up.
+ *
+ * The controller is active from the first target until an open loop PWM is set with setEncoderPwm(), while it is
+ * active the PWM ramping of the encoder library is not run.
+ * The gains of each wheel are loaded from the stored settings, the autotune finds them with a step test.
+ */
+
+#include <Arduino.h>
+
+/**
+ * @brief Struct holding the controller gains of one wheel.
+ */
+typedef struct {
+  float kp; /**< PWM per mm/s of speed error */
+  float ki; /**< PWM per mm of accumulated speed error */
+  float feedforwardPwmPerMmS; /**< PWM per mm/s of target speed, on top of WHEEL_SPEED_FEEDFORWARD_STATIC_PWM */
+} wheelSpeedGains_t;
+
+/**
+ * @brief Loads the gains of both wheels from the stored settings.
+ */
+void setupSpeedControl();
+
+/**
+ * @brief Sets the gains of the controller of one wheel.
+ * @param encoderNumber The encoder of the wheel, 1 or 2.
+ * @param gains The new gains.
+ */
+void setWheelSpeedGains(uint8_t encoderNumber, const wheelSpeedGains_t *gains);
+
+/**
+ * @brief Sets the target speeds of both wheels and activates the speed control.
+ * @param encoder1Speed Target of the wheel of encoder 1 in millimeters per second, with the sign of its pulse count.
+ * @param encoder2Speed Target of the wheel of encoder 2 in millimeters per second, with the sign of its pulse count.
+ */
+void setWheelSpeedTargets(float encoder1Speed, float encoder2Speed);
+
+/**
+ * @brief Sets a fixed PWM on both motors through the wheel control step, without regulating the speed.
+ * Used by the autotune, the PWM is applied at the same rate as with the speed control.
+ * @param encoder1Pwm PWM of the motor of encoder 1, -255 to 255.
+ * @param encoder2Pwm PWM of the motor of encoder 2, -255 to 255.
+ */
+void setWheelPwmTargets(int16_t encoder1Pwm, int16_t encoder2Pwm);
+
+/**
+ * @brief Deactivates the speed control, the PWM is then set by the encoder library.
+ */
+void stopWheelSpeedControl();
+
+/**
+ * @brief Checks if the speed control sets the motor PWM.
+ * @return True if the speed control is active.
+ */
+bool isWheelSpeedControlActive();
+
+/**
+ * @brief Runs the speed controllers of both wheels once, called from the wheel control step after the speeds are updated.
+ */
+void doWheelSpeedControlStep();
+
+#endif // SPEED_CONTROL_H
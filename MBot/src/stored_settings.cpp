@@ -0,0 +1,68 @@
+#include <EEPROM.h>
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include "config.h"
+#include "protocol.h"
+#include "stored_settings.h"
+
+#define STORED_SETTINGS_ADDRESS 0
+
+storedSettings_t storedSettings;
+
+//Next byte of storedSettings to compare with the EEPROM, sizeof(storedSettings_t) when nothing is left to write
+uint16_t storedSettingsWriteOffset = sizeof(storedSettings_t);
+
+static uint16_t calculateStoredSettingsCRC(const storedSettings_t *settings){
+  return calculateCRC16((const uint8_t *)settings, offsetof(storedSettings_t, crc));
+}
+
+static void setDefaultStoredSettings(){
+  storedSettings.version = STORED_SETTINGS_VERSION;
+  for(uint8_t wheel = 0; wheel < 2; wheel++){
+    storedSettings.wheelSpeedGains[wheel].kp = WHEEL_SPEED_KP;
+    storedSettings.wheelSpeedGains[wheel].ki = WHEEL_SPEED_KI;
+    storedSettings.wheelSpeedGains[wheel].feedforwardPwmPerMmS = WHEEL_SPEED_FEEDFORWARD_PWM_PER_MM_S;
+    storedSettings.millimeterPerPulse[wheel] = MILLIMETER_PER_ENCOER_PULSE;
+  }
+  storedSettings.pwmSpeedTableValid = 0;
+  memset(storedSettings.pwmSpeedTable, 0, sizeof(storedSettings.pwmSpeedTable));
+}
+
+void loadStoredSettings(){
+  EEPROM.get(STORED_SETTINGS_ADDRESS, storedSettings);
+  if(storedSettings.version != STORED_SETTINGS_VERSION || storedSettings.crc != calculateStoredSettingsCRC(&storedSettings)){
+    setDefaultStoredSettings();
+  }
+}
+
+storedSettings_t *getStoredSettings(){
+  return &storedSettings;
+}
+
+void saveStoredSettings(){
+  storedSettings.version = STORED_SETTINGS_VERSION;
+  storedSettings.crc = calculateStoredSettingsCRC(&storedSettings);
+  //Starting over also covers a save while the previous one is still being written
+  storedSettingsWriteOffset = 0;
+}
+
+/*
+ * Writing an EEPROM byte takes about 3.3 ms, in which the CPU could only wait. The write is started here and runs on in
+ * the hardware, so each tick writes at most one changed byte and returns at once when the previous one is not done.
+ * Comparing the unchanged bytes is quick, a save only costs as many ticks as bytes changed.
+ * Until the last byte is written the CRC does not match, so a reset in between loads the defaults instead of a mix.
+ */
+void doStoredSettingsTick(){
+  if(storedSettingsWriteOffset >= sizeof(storedSettings_t) || !eeprom_is_ready()){
+    return;
+  }
+  const uint8_t *settingsBytes = (const uint8_t *)&storedSettings;
+  while(storedSettingsWriteOffset < sizeof(storedSettings_t)){
+    uint16_t offset = storedSettingsWriteOffset++;
+    uint8_t *address = (uint8_t *)(STORED_SETTINGS_ADDRESS + offset);
+    if(eeprom_read_byte(address) != settingsBytes[offset]){
+      eeprom_write_byte(address, settingsBytes[offset]);
+      return;
+    }
+  }
+}
@@ -0,0 +1,57 @@
+/**
+ * @file stored_settings.h
+ * @brief Header file containing the settings kept in EEPROM.
+ */
+
+#ifndef STORED_SETTINGS_H
+#define STORED_SETTINGS_H
+
+/**
+ * @brief This module keeps the settings found by calibration and tuning in EEPROM, so they survive a reflash.
+ * The settings are read once at start, if the stored version or CRC does not match the defaults from config.h are used.
+ * Adding or changing a field requires a new STORED_SETTINGS_VERSION, which resets the stored settings to the defaults.
+ */
+
+#include <Arduino.h>
+#include "config.h"
+#include "speed_control.h"
+
+/**
+ * @brief Version of the layout of storedSettings_t.
+ */
+#define STORED_SETTINGS_VERSION 4
+
+/**
+ * @brief Struct holding all stored settings, written to EEPROM as is.
+ */
+typedef struct {
+  uint8_t version; /**< STORED_SETTINGS_VERSION when written */
+  wheelSpeedGains_t wheelSpeedGains[2]; /**< Speed controller gains of the wheels of encoder 1 and 2 */
+  float millimeterPerPulse[2]; /**< Distance per pulse of channel A of the wheels of encoder 1 and 2 */
+  uint8_t pwmSpeedTableValid; /**< 1 once the PWM sweep has filled pwmSpeedTable */
+  int16_t pwmSpeedTable[2][2][PWM_SPEED_TABLE_SIZE]; /**< Speed in mm/s per encoder, direction (forward PWM, reverse PWM) and PWM level */
+  uint16_t crc; /**< CRC16 of all fields before it */
+} storedSettings_t;
+
+/**
+ * @brief Reads the settings from EEPROM, or the defaults if none are stored.
+ */
+void loadStoredSettings();
+
+/**
+ * @brief Retrieves the settings in RAM, changes are kept until the next start unless saveStoredSettings() is called.
+ * @return Pointer to the settings.
+ */
+storedSettings_t *getStoredSettings();
+
+/**
+ * @brief Queues the settings to be written to EEPROM by doStoredSettingsTick(), so the caller does not wait for it.
+ */
+void saveStoredSettings();
+
+/**
+ * @brief Performs a stored settings tick, writing at most one changed byte to EEPROM. Each byte takes about 3.3 ms.
+ */
+void doStoredSettingsTick();
+
+#endif // STORED_SETTINGS_H
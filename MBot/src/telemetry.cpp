@@ -0,0 +1,141 @@
+#include "config.h"
+#include "serial.h"
+#include "temperature.h"
+#include "telemetry.h"
+#include "uart.h"
+#include "scheduler.h"
+#include "profiler.h"
+#include "control_timer.h"
+
+//Worst case size of each stream on the wire, used for the bandwidth budget
+//ASCII lines include "\r\n", binary frames are the payload plus type, CRC, COBS code byte and delimiter
+const uint8_t telemetryAsciiMessageSize[NUMBER_OF_TELEMETRY_STREAMS] = {10, 27, 10, 68, 22};
+const uint8_t telemetryBinaryMessageSize[NUMBER_OF_TELEMETRY_STREAMS] = {7, 13, 7, 24, 11};
+
+uint16_t telemetryPeriodMs[NUMBER_OF_TELEMETRY_STREAMS];
+unsigned long timeForNextTelemetry[NUMBER_OF_TELEMETRY_STREAMS];
+uint8_t nextTelemetryStreamToCheck = 0;
+
+//Token bucket: bytes telemetry is currently allowed to send
+uint16_t telemetryBudgetBytes = TELEMETRY_BANDWIDTH_BURST_BYTES;
+unsigned long timeAtLastBudgetUpdate = 0;
+
+//Loop statistics
+unsigned long timeAtLastLoopIteration = 0;
+unsigned long timeAtLastLoopCount = 0;
+uint16_t loopsThisSecond = 0;
+uint16_t loopsPerSecond = 0;
+uint16_t maxLoopTimeMicros = 0;
+
+void setupTelemetry(){
+  setTelemetryPeriod(TELEMETRY_TEMPERATURE, TELEMETRY_TEMPERATURE_PERIOD_MS);
+  setTelemetryPeriod(TELEMETRY_ENCODERS, TELEMETRY_ENCODERS_PERIOD_MS);
+  setTelemetryPeriod(TELEMETRY_GYRO, TELEMETRY_GYRO_PERIOD_MS);
+  setTelemetryPeriod(TELEMETRY_POSE, TELEMETRY_POSE_PERIOD_MS);
+  setTelemetryPeriod(TELEMETRY_LOOP_STATS, TELEMETRY_LOOP_STATS_PERIOD_MS);
+}
+
+//Keeps track of how often and how regularly the main loop runs
+void recordLoopIteration(){
+  unsigned long now = micros();
+  unsigned long loopTime = now - timeAtLastLoopIteration;
+  timeAtLastLoopIteration = now;
+  if(loopTime > maxLoopTimeMicros){
+    maxLoopTimeMicros = loopTime > 0xFFFF ? 0xFFFF : loopTime;
+  }
+
+  loopsThisSecond++;
+  if(millis() - timeAtLastLoopCount >= 1000){
+    timeAtLastLoopCount = millis();
+    loopsPerSecond = loopsThisSecond;
+    loopsThisSecond = 0;
+  }
+}
+
+void updateTelemetryBudget(){
+  unsigned long elapsedMs = millis() - timeAtLastBudgetUpdate;
+  uint16_t earnedBytes = min(elapsedMs, 1000UL) * TELEMETRY_BANDWIDTH_BYTES_PER_SECOND / 1000;
+  if(earnedBytes == 0){
+    return;
+  }
+  //Only the time that was turned into whole bytes is consumed, so slow ticks do not lose budget
+  timeAtLastBudgetUpdate += (unsigned long)earnedBytes * 1000 / TELEMETRY_BANDWIDTH_BYTES_PER_SECOND;
+  telemetryBudgetBytes = min(telemetryBudgetBytes + earnedBytes, TELEMETRY_BANDWIDTH_BURST_BYTES);
+}
+
+void sendTelemetryStream(telemetryStream_t stream){
+  switch(stream){
+    case(TELEMETRY_TEMPERATURE):
+      sendTemperatureTransmission(getCurrentTemperature());
+      break;
+    case(TELEMETRY_ENCODERS):
+      sendEncoderTransmission();
+      break;
+    case(TELEMETRY_GYRO):
+      sendGyroTransmission();
+      break;
+    case(TELEMETRY_POSE):
+      sendSerialCoordinates();
+      break;
+    case(TELEMETRY_LOOP_STATS):
+      sendLoopStatsTransmission(getLoopsPerSecond(), getMaxLoopTimeMicros(), getTotalTaskOverruns() + getControlStepOverruns());
+      maxLoopTimeMicros = 0;
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+ * Sends at most one due stream per call, starting the search after the stream sent last so no stream starves the others.
+ * A due stream is held back (not skipped) while the budget or the free space in the transmit buffer is too small,
+ * the free space always keeps TELEMETRY_TX_RESERVE_BYTES for acks.
+ */
+void sendDueTelemetryStream(){
+  for(uint8_t i = 0; i < NUMBER_OF_TELEMETRY_STREAMS; i++){
+    uint8_t stream = (nextTelemetryStreamToCheck + i) % NUMBER_OF_TELEMETRY_STREAMS;
+    if(telemetryPeriodMs[stream] == 0 || (long)(millis() - timeForNextTelemetry[stream]) < 0){
+      continue;
+    }
+
+    uint8_t messageSize = getSerialLinkMode() == BINARY_LINK ? telemetryBinaryMessageSize[stream] : telemetryAsciiMessageSize[stream];
+    if(telemetryBudgetBytes < messageSize || PiSerial.availableForWrite() < messageSize + TELEMETRY_TX_RESERVE_BYTES){
+      return;
+    }
+
+    telemetryBudgetBytes -= messageSize;
+    timeForNextTelemetry[stream] = millis() + telemetryPeriodMs[stream];
+    nextTelemetryStreamToCheck = (stream + 1) % NUMBER_OF_TELEMETRY_STREAMS;
+    sendTelemetryStream((telemetryStream_t)stream);
+    return;
+  }
+}
+
+void doTelemetryTick(){
+  PROFILE_START(PROFILE_TELEMETRY);
+  recordLoopIteration();
+  updateTelemetryBudget();
+  sendDueTelemetryStream();
+  PROFILE_END(PROFILE_TELEMETRY);
+}
+
+bool setTelemetryPeriod(uint8_t stream, uint16_t periodMs){
+  if(stream >= NUMBER_OF_TELEMETRY_STREAMS){
+    return false;
+  }
+  telemetryPeriodMs[stream] = periodMs;
+  timeForNextTelemetry[stream] = millis() + periodMs;
+  return true;
+}
+
+uint16_t getTelemetryPeriod(telemetryStream_t stream){
+  return telemetryPeriodMs[stream];
+}
+
+uint16_t getLoopsPerSecond(){
+  return loopsPerSecond;
+}
+
+uint16_t getMaxLoopTimeMicros(){
+  return maxLoopTimeMicros;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file telemetry.h
+ * @brief Header file containing the scheduler for telemetry sent to the Pi.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/**
+ * @brief This module decides when each telemetry stream is sent to the Pi.
+ * Every stream has its own period in milliseconds (0 turns it off), the defaults are found in config.h and can be changed from the Pi.
+ * All streams share a bandwidth budget and always leave room in the transmit buffer, so telemetry never delays command acks.
+ */
+
+#include <Arduino.h>
+
+/**
+ * @brief Enum defining the telemetry streams, the values are used by the Pi when setting rates.
+ */
+typedef enum {
+  TELEMETRY_TEMPERATURE, /**< Onboard temperature */
+  TELEMETRY_ENCODERS, /**< Pulse count of both encoders */
+  TELEMETRY_GYRO, /**< Gyro yaw (Z angle) */
+  TELEMETRY_POSE, /**< Dead-reckoning coordinates and heading */
+  TELEMETRY_LOOP_STATS, /**< Main loop iterations per second, longest iteration and scheduler task and wheel control step overruns */
+  NUMBER_OF_TELEMETRY_STREAMS
+} telemetryStream_t;
+
+/**
+ * @brief Sets up the default period of every telemetry stream.
+ */
+void setupTelemetry();
+
+/**
+ * @brief Performs a telemetry tick, sending the streams that are due if the budget allows. Call once per main loop iteration.
+ */
+void doTelemetryTick();
+
+/**
+ * @brief Sets the period of a telemetry stream.
+ * @param stream The stream to change, see telemetryStream_t.
+ * @param periodMs New period in milliseconds, 0 turns the stream off.
+ * @return True if the stream exists, otherwise false.
+ */
+bool setTelemetryPeriod(uint8_t stream, uint16_t periodMs);
+
+/**
+ * @brief Retrieves the period of a telemetry stream.
+ * @param stream The stream, see telemetryStream_t.
+ * @return The period in milliseconds, 0 if the stream is off.
+ */
+uint16_t getTelemetryPeriod(telemetryStream_t stream);
+
+/**
+ * @brief Retrieves the number of main loop iterations during the last completed second.
+ * @return Loop iterations per second.
+ */
+uint16_t getLoopsPerSecond();
+
+/**
+ * @brief Retrieves the longest main loop iteration since the last loop statistics transmission.
+ * @return The longest iteration in microseconds.
+ */
+uint16_t getMaxLoopTimeMicros();
+
+#endif // TELEMETRY_H
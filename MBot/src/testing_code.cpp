@@ -8,12 +8,30 @@
 #include "motorcontrol.h"
 #include "localization.h"
 #include "serial.h"
+#include "uart.h"
+#include "fixed_point.h"
+
+#define BENCHMARK_ITERATIONS 1000
+
+//Volatile so the compiler can neither move the operations out of the loops nor drop them
+volatile float benchmarkFloatInput = 0.7;
+volatile float benchmarkFloatOutput = 0;
+volatile fixed_t benchmarkFixedInput = 45875; //0.7 in Q16.16
+volatile fixed_t benchmarkFixedOutput = 0;
+volatile binaryAngle_t benchmarkAngleInput = 7300; //about 40 degrees
+volatile int16_t benchmarkQ15Output = 0;
+
+#define MEASURE_BENCHMARK_MICROS(result, operation) { \
+  unsigned long benchmarkStart = micros(); \
+  for(uint16_t i = 0; i < BENCHMARK_ITERATIONS; i++){ operation; } \
+  result = micros() - benchmarkStart; \
+}
 
 bool TESTfirstTapeFound = false;
 bool TESTsecondTapeFound = false;
 
 void doDrivingInASquareTest(){
-  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
       
   calculateAndUpdateXAndYCoordinates();
   
@@ -22,13 +40,13 @@ void doDrivingInASquareTest(){
   stopMotorsMS(3000);
   
 
-  rotateByDegrees(90, LEFT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  rotateByDegrees(90, LEFT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   
 
   stopMotorsMS(3000);
 
-  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   calculateAndUpdateXAndYCoordinates();
   
@@ -36,13 +54,13 @@ void doDrivingInASquareTest(){
 
   stopMotorsMS(3000);
 
-  rotateByDegrees(90, LEFT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  rotateByDegrees(90, LEFT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   
 
   stopMotorsMS(3000);
 
-  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   calculateAndUpdateXAndYCoordinates();
   
@@ -50,13 +68,13 @@ void doDrivingInASquareTest(){
 
   stopMotorsMS(3000);
 
-  rotateByDegrees(90, LEFT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  rotateByDegrees(90, LEFT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   
 
   stopMotorsMS(3000);
 
-  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   calculateAndUpdateXAndYCoordinates();
   
@@ -66,11 +84,11 @@ void doDrivingInASquareTest(){
 
 
 
-  rotateByDegrees(180, RIGHT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  rotateByDegrees(180, RIGHT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
   
   stopMotorsMS(3000);
 
-  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   calculateAndUpdateXAndYCoordinates();
   
@@ -78,11 +96,11 @@ void doDrivingInASquareTest(){
 
   stopMotorsMS(3000);
 
-  rotateByDegrees(90, RIGHT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  rotateByDegrees(90, RIGHT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
   
   stopMotorsMS(3000);
 
-  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   calculateAndUpdateXAndYCoordinates();
   
@@ -90,11 +108,11 @@ void doDrivingInASquareTest(){
 
   stopMotorsMS(3000);
 
-  rotateByDegrees(90, RIGHT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  rotateByDegrees(90, RIGHT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
   
   stopMotorsMS(3000);
 
-  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   calculateAndUpdateXAndYCoordinates();
   
@@ -102,11 +120,11 @@ void doDrivingInASquareTest(){
 
   stopMotorsMS(3000);
 
-  rotateByDegrees(90, RIGHT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  rotateByDegrees(90, RIGHT, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
   
   stopMotorsMS(3000);
 
-  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_PWM_FACTOR);
+  driveDistance(500, FORWARD, MOTOR_SPEED_AUTONOMOUS_FORWARD * PERCENTAGE_TO_WHEEL_SPEED_FACTOR);
 
   calculateAndUpdateXAndYCoordinates();
   
@@ -121,17 +139,50 @@ void doDrivingInASquareTest(){
 }
 
 void doRotationTest(){
-  rotateByDegrees(90, LEFT, MAX_MOTOR_SPEED);
+  rotateByDegrees(90, LEFT, WHEEL_MAX_SPEED_MM_PER_S);
 
   stopMotorsMS(3000);
 
-  rotateByDegrees(180, RIGHT, MAX_MOTOR_SPEED);
+  rotateByDegrees(180, RIGHT, WHEEL_MAX_SPEED_MM_PER_S);
 
   stopMotorsMS(3000);
 
-  rotateByDegrees(270, RIGHT, MAX_MOTOR_SPEED);
+  rotateByDegrees(270, RIGHT, WHEEL_MAX_SPEED_MM_PER_S);
 
   stopMotorsMS(3000);
 
-  rotateByDegrees(360, LEFT, MAX_MOTOR_SPEED);
+  rotateByDegrees(360, LEFT, WHEEL_MAX_SPEED_MM_PER_S);
+}
+
+/*
+ * The loop with only the volatile accesses is measured first and taken off every operation. Every line is sent after
+ * two measurements of at least a few milliseconds, so the transmit buffer has room for it again.
+ */
+static void printBenchmarkCycles(const char *name, unsigned long floatMicros, unsigned long fixedMicros, unsigned long overheadMicros){
+  long floatCycles = ((long)floatMicros - (long)overheadMicros) * (F_CPU / 1000000) / BENCHMARK_ITERATIONS;
+  long fixedCycles = ((long)fixedMicros - (long)overheadMicros) * (F_CPU / 1000000) / BENCHMARK_ITERATIONS;
+  sendSerialLine("%s cycles, float: %ld, fixed: %ld", name, floatCycles, fixedCycles);
+}
+
+void doFixedPointBenchmark(){
+  unsigned long overheadMicros, floatMicros, fixedMicros;
+
+  MEASURE_BENCHMARK_MICROS(overheadMicros, benchmarkFloatOutput = benchmarkFloatInput);
+
+  MEASURE_BENCHMARK_MICROS(floatMicros, benchmarkFloatOutput = benchmarkFloatInput * benchmarkFloatInput);
+  MEASURE_BENCHMARK_MICROS(fixedMicros, benchmarkFixedOutput = fixedMul(benchmarkFixedInput, benchmarkFixedInput));
+  printBenchmarkCycles("Multiply", floatMicros, fixedMicros, overheadMicros);
+
+  MEASURE_BENCHMARK_MICROS(floatMicros, benchmarkFloatOutput = sin(benchmarkFloatInput));
+  MEASURE_BENCHMARK_MICROS(fixedMicros, benchmarkQ15Output = fixedSin(benchmarkAngleInput));
+  printBenchmarkCycles("Sin", floatMicros, fixedMicros, overheadMicros);
+
+  MEASURE_BENCHMARK_MICROS(floatMicros, benchmarkFloatOutput = atan2(benchmarkFloatInput, 1.3));
+  MEASURE_BENCHMARK_MICROS(fixedMicros, benchmarkFixedOutput = fixedAtan2(benchmarkFixedInput, 85197));
+  printBenchmarkCycles("Atan2", floatMicros, fixedMicros, overheadMicros);
+
+  //One axis of an odometry step, a distance along a heading, each kept in its own number format
+  MEASURE_BENCHMARK_MICROS(floatMicros, benchmarkFloatOutput = benchmarkFloatInput * sin(benchmarkFloatInput));
+  MEASURE_BENCHMARK_MICROS(fixedMicros, benchmarkFixedOutput = fixedMulQ15(benchmarkFixedInput, fixedSin(benchmarkAngleInput)));
+  printBenchmarkCycles("Odometry axis", floatMicros, fixedMicros, overheadMicros);
 }
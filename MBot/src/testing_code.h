@@ -22,4 +22,10 @@ void doDrivingInASquareTest();
  */
 void doRotationTest();
 
+/**
+ * @brief Measures the cycles per operation of the fixed point library against the soft float versions and prints them.
+ * The interrupts keep running, so the numbers are slightly high. Sent as "bench" in standby on the ASCII link.
+ */
+void doFixedPointBenchmark();
+
 #endif // TESTING_FUNCTIONS_H
@@ -0,0 +1,206 @@
+#include <util/atomic.h>
+#include "uart.h"
+
+static_assert(UART_RX_BUFFER_SIZE <= 256 && (UART_RX_BUFFER_SIZE & (UART_RX_BUFFER_SIZE - 1)) == 0, "UART_RX_BUFFER_SIZE must be a power of two, at most 256");
+static_assert(UART_TX_BUFFER_SIZE <= 256 && (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)) == 0, "UART_TX_BUFFER_SIZE must be a power of two, at most 256");
+
+#define UART_RX_BUFFER_MASK (UART_RX_BUFFER_SIZE - 1)
+#define UART_TX_BUFFER_MASK (UART_TX_BUFFER_SIZE - 1)
+
+UartSerial PiSerial;
+
+//Ring buffers, the interrupts own rxHead and txTail, the main program owns rxTail and txHead
+uint8_t rxBuffer[UART_RX_BUFFER_SIZE];
+volatile uint8_t rxHead = 0;
+volatile uint8_t rxTail = 0;
+
+uint8_t txBuffer[UART_TX_BUFFER_SIZE];
+volatile uint8_t txHead = 0;
+volatile uint8_t txTail = 0;
+bool uartHasTransmitted = false;
+
+volatile uartStatistics_t uartStatistics;
+
+//Moves the next queued byte to the hardware, used by the interrupt and by write()/flush() when interrupts are off
+static void transmitNextByte(){
+  UDR0 = txBuffer[txTail];
+  txTail = (txTail + 1) & UART_TX_BUFFER_MASK;
+  UCSR0A = (UCSR0A & _BV(U2X0)) | _BV(TXC0); //Writing 1 clears the transmit complete flag
+  if(txHead == txTail){
+    UCSR0B &= ~_BV(UDRIE0);
+  }
+}
+
+/*
+ * The status register must be read before the data register, otherwise the error flags of the byte are lost.
+ * A data overrun means bytes before this one were lost in hardware, the byte itself is fine.
+ * A byte with a framing error is garbage and dropped.
+ */
+ISR(USART0_RX_vect){
+  uint8_t status = UCSR0A;
+  uint8_t data = UDR0;
+
+  if(status & _BV(DOR0)){
+    uartStatistics.rxOverruns++;
+  }
+  if(status & _BV(FE0)){
+    uartStatistics.rxFramingErrors++;
+    return;
+  }
+
+  uint8_t nextHead = (rxHead + 1) & UART_RX_BUFFER_MASK;
+  if(nextHead == rxTail){
+    uartStatistics.rxBufferOverflows++;
+    return;
+  }
+  rxBuffer[rxHead] = data;
+  rxHead = nextHead;
+
+  uint8_t bytesWaiting = (rxHead - rxTail) & UART_RX_BUFFER_MASK;
+  if(bytesWaiting > uartStatistics.rxHighWaterMark){
+    uartStatistics.rxHighWaterMark = bytesWaiting;
+  }
+}
+
+ISR(USART0_UDRE_vect){
+  transmitNextByte();
+}
+
+/*
+ * 8 data bits, no parity, 1 stop bit, always in double speed mode. At 57600 baud on 16 MHz that is UBRR 34 with a baud
+ * error of -0.8%, normal speed would be UBRR 16 with +2.1%. The Arduino core leaves U2X off at exactly this rate (for
+ * old bootloaders), so the bit timing differs from the HardwareSerial it replaces, it is closer to the Pi's 57600.
+ */
+void UartSerial::begin(unsigned long baud){
+  uint16_t baudSetting = (F_CPU / 4 / baud - 1) / 2;
+
+  UCSR0A = _BV(U2X0);
+  UBRR0H = baudSetting >> 8;
+  UBRR0L = baudSetting;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+int UartSerial::available(){
+  return (uint8_t)(rxHead - rxTail) & UART_RX_BUFFER_MASK;
+}
+
+int UartSerial::peek(){
+  if(rxHead == rxTail){
+    return -1;
+  }
+  return rxBuffer[rxTail];
+}
+
+int UartSerial::read(){
+  if(rxHead == rxTail){
+    return -1;
+  }
+  uint8_t b = rxBuffer[rxTail];
+  rxTail = (rxTail + 1) & UART_RX_BUFFER_MASK;
+  return b;
+}
+
+int UartSerial::availableForWrite(){
+  uint8_t head;
+  uint8_t tail;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    head = txHead;
+    tail = txTail;
+  }
+  return UART_TX_BUFFER_MASK - ((uint8_t)(head - tail) & UART_TX_BUFFER_MASK);
+}
+
+void UartSerial::flush(){
+  if(!uartHasTransmitted){
+    return;
+  }
+  while((UCSR0B & _BV(UDRIE0)) || !(UCSR0A & _BV(TXC0))){
+    if(!(SREG & _BV(SREG_I)) && (UCSR0B & _BV(UDRIE0)) && (UCSR0A & _BV(UDRE0))){
+      transmitNextByte();
+    }
+  }
+}
+
+size_t UartSerial::write(uint8_t b){
+  uartHasTransmitted = true;
+
+  //Nothing queued and the hardware is free, skip the buffer
+  if(txHead == txTail && (UCSR0A & _BV(UDRE0))){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+      UDR0 = b;
+      UCSR0A = (UCSR0A & _BV(U2X0)) | _BV(TXC0);
+    }
+    return 1;
+  }
+
+  uint8_t nextHead = (txHead + 1) & UART_TX_BUFFER_MASK;
+  while(nextHead == txTail){
+    //Buffer full, if interrupts are off nobody else will empty it
+    if(!(SREG & _BV(SREG_I)) && (UCSR0A & _BV(UDRE0))){
+      transmitNextByte();
+    }
+  }
+
+  txBuffer[txHead] = b;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    txHead = nextHead;
+    UCSR0B |= _BV(UDRIE0);
+
+    uint8_t bytesWaiting = (txHead - txTail) & UART_TX_BUFFER_MASK;
+    if(bytesWaiting > uartStatistics.txHighWaterMark){
+      uartStatistics.txHighWaterMark = bytesWaiting;
+    }
+  }
+  return 1;
+}
+
+bool UartSerial::writeNonBlocking(const uint8_t *buffer, uint8_t length){
+  if(availableForWrite() < length){
+    uartStatistics.txDroppedMessages++;
+    return false;
+  }
+  uartHasTransmitted = true;
+
+  //Only this function and write() move txHead, so the free space checked above cannot shrink
+  uint8_t head = txHead;
+  for(uint8_t i = 0; i < length; i++){
+    txBuffer[head] = buffer[i];
+    head = (head + 1) & UART_TX_BUFFER_MASK;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    txHead = head;
+    UCSR0B |= _BV(UDRIE0);
+
+    uint8_t bytesWaiting = (txHead - txTail) & UART_TX_BUFFER_MASK;
+    if(bytesWaiting > uartStatistics.txHighWaterMark){
+      uartStatistics.txHighWaterMark = bytesWaiting;
+    }
+  }
+  return true;
+}
+
+uartStatistics_t UartSerial::getStatistics(){
+  uartStatistics_t statistics;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    statistics.rxOverruns = uartStatistics.rxOverruns;
+    statistics.rxFramingErrors = uartStatistics.rxFramingErrors;
+    statistics.rxBufferOverflows = uartStatistics.rxBufferOverflows;
+    statistics.rxHighWaterMark = uartStatistics.rxHighWaterMark;
+    statistics.txHighWaterMark = uartStatistics.txHighWaterMark;
+    statistics.txDroppedMessages = uartStatistics.txDroppedMessages;
+  }
+  return statistics;
+}
+
+void UartSerial::resetStatistics(){
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    uartStatistics.rxOverruns = 0;
+    uartStatistics.rxFramingErrors = 0;
+    uartStatistics.rxBufferOverflows = 0;
+    uartStatistics.rxHighWaterMark = 0;
+    uartStatistics.txHighWaterMark = 0;
+    uartStatistics.txDroppedMessages = 0;
+  }
+}
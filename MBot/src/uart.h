@@ -0,0 +1,107 @@
+/**
+ * @file uart.h
+ * @brief Header file containing the interrupt driven driver for the serial port connected to the Pi (USART0).
+ */
+
+#ifndef UART_H
+#define UART_H
+
+/**
+ * @brief This module replaces the Arduino HardwareSerial "Serial" with a driver that has larger, configurable ring buffers
+ * and counts every way a received byte can get lost: hardware overrun, framing error and full receive buffer.
+ * The buffer sizes are set in config.h.
+ *
+ * OBS: "Serial" must not be used anywhere in the firmware. Referencing it links the Arduino core's USART0 interrupts,
+ * which collide with the ones defined here.
+ */
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * @brief Struct holding the error and load counters of the serial port.
+ */
+typedef struct {
+  uint16_t rxOverruns; /**< Bytes lost in hardware because the receive interrupt ran too late (DOR0) */
+  uint16_t rxFramingErrors; /**< Bytes dropped because of a missing stop bit (FE0) */
+  uint16_t rxBufferOverflows; /**< Bytes dropped because the receive ring buffer was full */
+  uint16_t rxHighWaterMark; /**< Highest number of bytes waiting in the receive ring buffer */
+  uint16_t txHighWaterMark; /**< Highest number of bytes waiting in the transmit ring buffer */
+  uint16_t txDroppedMessages; /**< Messages not queued by writeNonBlocking() because the transmit ring buffer was full */
+} uartStatistics_t;
+
+/**
+ * @brief Serial port with interrupt driven receive and transmit ring buffers.
+ */
+class UartSerial : public Stream {
+  public:
+    /**
+     * @brief Starts the serial port.
+     * @param baud The baud rate.
+     */
+    void begin(unsigned long baud);
+
+    /**
+     * @brief Retrieves the number of received bytes waiting to be read.
+     * @return The number of bytes available.
+     */
+    int available();
+
+    /**
+     * @brief Retrieves the next received byte without removing it.
+     * @return The byte, or -1 if nothing is available.
+     */
+    int peek();
+
+    /**
+     * @brief Reads the next received byte.
+     * @return The byte, or -1 if nothing is available.
+     */
+    int read();
+
+    /**
+     * @brief Retrieves the free space in the transmit ring buffer.
+     * @return The number of bytes that can be written without waiting.
+     */
+    int availableForWrite();
+
+    /**
+     * @brief Waits until every queued byte has been transmitted.
+     */
+    void flush();
+
+    /**
+     * @brief Queues one byte for transmission, waits if the transmit ring buffer is full.
+     * @param b The byte to send.
+     * @return The number of bytes written.
+     */
+    size_t write(uint8_t b);
+    using Print::write;
+
+    /**
+     * @brief Queues a complete message for transmission without waiting, the interrupt sends it in the background.
+     * The message is queued as a whole or not at all, so the Pi never receives half a message.
+     * @param buffer The message.
+     * @param length Number of bytes in the message.
+     * @return True if the message was queued, false if it was dropped because the transmit ring buffer is full.
+     */
+    bool writeNonBlocking(const uint8_t *buffer, uint8_t length);
+
+    /**
+     * @brief Retrieves a copy of the error and load counters.
+     * @return The counters.
+     */
+    uartStatistics_t getStatistics();
+
+    /**
+     * @brief Resets the error and load counters.
+     */
+    void resetStatistics();
+};
+
+/**
+ * @brief The serial port connected to the Pi.
+ */
+extern UartSerial PiSerial;
+
+#endif // UART_H
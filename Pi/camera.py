@@ -1,4 +1,5 @@
 import cv2
+import queue
 import time
 
 import settings
@@ -13,11 +14,15 @@ class PiCamera:
         self.camera.set(cv2.CAP_PROP_FRAME_HEIGHT, settings.RESOLUTION_VGA[1])
         self.latest_frame = None 
         self.new_frame_ready = False
+        self.frame_number = 0
+        self.capture_time = None # time.monotonic() when the latest frame was read
 
     def update_frame(self):
         """Update the camera frame."""
         ret, frame = self.camera.read()
         if ret:
+            self.capture_time = time.monotonic()
+            self.frame_number += 1
             frame = cv2.flip(frame, -1)  # Flips both vertically and horizontally
             
             _, jpeg_frame = cv2.imencode('.jpg', frame)
@@ -31,6 +36,10 @@ class PiCamera:
         self.new_frame_ready = False
         return self.latest_frame
 
+    def get_latest_capture(self):
+        """Get the number and capture time of the latest camera frame."""
+        return self.frame_number, self.capture_time
+
     def is_new_frame_ready(self):
         """Check if a new frame is ready."""
         return self.new_frame_ready
@@ -39,8 +48,8 @@ class PiCamera:
         """Release the camera resources."""
         self.camera.release()
 
-def run_camera(camera, mqtt_client):
-    """Run the camera continuously and publish frames via MQTT."""
+def run_camera(camera, mqtt_client, pose_queries=None):
+    """Run the camera continuously and publish frames via MQTT, the capture of every frame is put in pose_queries."""
     while True:
         start_time = time.time()
         camera.update_frame()
@@ -49,6 +58,11 @@ def run_camera(camera, mqtt_client):
             frame = camera.get_latest_frame()
             if frame:
                 mqtt_client.publish(settings.TOPIC_CAMERA_DATA, frame)
+                if pose_queries is not None:
+                    try:
+                        pose_queries.put_nowait(camera.get_latest_capture())
+                    except queue.Full:
+                        pass # The serial thread is not asking poses, e.g. on the ASCII link
 
         elapsed_time = time.time() - start_time
         sleep_time = max(0, settings.CAMERA_THREAD_SLEEP_TIME_IN_SECONDS - elapsed_time)
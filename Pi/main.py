@@ -1,4 +1,5 @@
 import argparse
+import queue
 import threading
 import time
 
@@ -28,11 +29,12 @@ if __name__ == "__main__":
     # Instantiation
     my_camera = PiCamera() if not args.camera_off else None
     mqtt_client = MQTTClient(mqtt_id=settings.RPI_CLIENT_ID)
+    pose_queries = queue.Queue(maxsize=settings.POSE_QUERY_QUEUE_SIZE) # Camera frames whose pose is asked from the MBot
 
     # Thread creations
     mqtt_thread = threading.Thread(target=run_mqtt_subscriber, args=[mqtt_client])
-    camera_thread = threading.Thread(target=run_camera, args=[my_camera, mqtt_client]) if not args.camera_off else None
-    serial_thread = threading.Thread(target=run_serial, args=[mqtt_client])
+    camera_thread = threading.Thread(target=run_camera, args=[my_camera, mqtt_client, pose_queries]) if not args.camera_off else None
+    serial_thread = threading.Thread(target=run_serial, args=[mqtt_client, pose_queries])
 
     # Thread starts
     mqtt_thread.start()
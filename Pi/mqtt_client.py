@@ -170,6 +170,7 @@ def run_mqtt_subscriber(mqtt_client):
         mqtt_client.subscribe(topic=settings.TOPIC_ROBOT_STATE)
         mqtt_client.subscribe(topic=settings.TOPIC_MOTOR_CONTROL_SPEED)
         mqtt_client.subscribe(topic=settings.TOPIC_MOTOR_CONTROL_DIRECTION)
+        mqtt_client.subscribe(topic=settings.TOPIC_TELEMETRY_RATE)
     except Exception as e:
         print("Exception MQTT Client:", e)
 
@@ -1,6 +1,9 @@
 import serial
 import time
+import json
+from collections import OrderedDict, deque
 import settings
+import serial_protocol
 
 class SerialCommunication:
     """Class to handle serial communication."""
@@ -17,6 +20,88 @@ class SerialCommunication:
         self.serial_port = serial.Serial(port, baudrate, timeout=timeout)
         self.sent_commands = []
         self.unack_counter = 0   # Counter for unacknowledged commands
+        self.binary_mode = False # True once the MBot has accepted the binary framed protocol
+        self.frame_reader = serial_protocol.FrameReader()
+        self.pending_frames = [] # Frames received while waiting for the window, handled by the main loop
+        self.next_sequence = 0
+        self.in_flight = OrderedDict() # Sequence number -> [command, time sent] of binary commands not yet acked
+        self.last_command_time = time.time() # Time the last binary command was sent, for the keepalive
+
+    def negotiate_binary_protocol(self):
+        """
+        Ask the MBot to switch to the binary framed protocol using the hello command.
+
+        Returns:
+        - binary_mode (bool): True if the MBot switched to the binary protocol.
+        """
+        response = self.send_command(settings.BINARY_HELLO_COMMAND + '\n')
+        self.sent_commands.clear()
+        self.binary_mode = response.strip().endswith(settings.BINARY_HELLO_COMMAND)
+        if not self.binary_mode:
+            # The MBot may still be in binary mode from an earlier session, a binary hello resynchronizes it
+            self.binary_mode = True
+            self.send_command(settings.BINARY_HELLO_COMMAND)
+            self.binary_mode = self.wait_for_acks()
+            self.in_flight.clear()
+        return self.binary_mode
+
+    def read_frames(self):
+        """
+        Read all available bytes, handle acks and return the other frames completed by them.
+        Commands not acked in time are resent, together with all commands sent after them (go-back-N).
+
+        Returns:
+        - frames (list): List of (message_type, payload) tuples.
+        """
+        frames = self.pending_frames
+        self.pending_frames = []
+        if self.serial_port.in_waiting > 0:
+            for message_type, payload in self.frame_reader.feed(self.serial_port.read(self.serial_port.in_waiting)):
+                if message_type == serial_protocol.MSG_ACK and len(payload) == 1:
+                    self.handle_cumulative_ack(payload[0])
+                elif message_type == serial_protocol.MSG_NOK and len(payload) == 2:
+                    if self.in_flight.pop(payload[0], None) is not None:
+                        self.unack_counter += 1
+                else:
+                    frames.append((message_type, payload))
+
+        if self.in_flight:
+            oldest_time_sent = next(iter(self.in_flight.values()))[1]
+            if time.time() - oldest_time_sent > settings.SERIAL_ACK_TIMEOUT_IN_SECONDS:
+                self.resend_in_flight_commands()
+        return frames
+
+    def handle_cumulative_ack(self, ack_sequence):
+        """
+        Remove every in-flight command covered by a cumulative ack.
+
+        Args:
+        - ack_sequence (int): Sequence number of the last command the MBot handled in order.
+        """
+        for sequence in list(self.in_flight):
+            if not serial_protocol.is_sequence_acked(sequence, ack_sequence):
+                break
+            del self.in_flight[sequence]
+
+    def resend_in_flight_commands(self):
+        """Resend all unacknowledged commands in the order they were first sent."""
+        now = time.time()
+        for sequence, entry in self.in_flight.items():
+            self.serial_port.write(serial_protocol.encode_command(entry[0], sequence))
+            entry[1] = now
+
+    def wait_for_acks(self):
+        """
+        Wait until all in-flight commands are acknowledged, at most the serial timeout.
+
+        Returns:
+        - bool: True if all commands were acknowledged.
+        """
+        deadline = time.time() + self.serial_port.timeout
+        while self.in_flight and time.time() < deadline:
+            self.pending_frames.extend(self.read_frames())
+            time.sleep(0.001)
+        return not self.in_flight
 
     def send_command(self, command):
         """
@@ -28,6 +113,9 @@ class SerialCommunication:
         Returns:
         - response (str): Response received after sending the command.
         """
+        if self.binary_mode:
+            return self.send_binary_command(command)
+
         self.serial_port.write(command.encode())
         time.sleep(0.1)
         response = self.serial_port.read_until(b'!').decode().rstrip('!')  # Wait for '!' and remove it from response
@@ -38,6 +126,455 @@ class SerialCommunication:
 
         return response
 
+    def send_binary_command(self, command):
+        """
+        Send a command as a binary frame with the next sequence number, without waiting for its ack.
+        Up to SERIAL_COMMAND_WINDOW_SIZE commands may be in flight, when the window is full this waits for acks and
+        resynchronizes the link if they do not come within the serial timeout.
+
+        Args:
+        - command (str): ASCII command to be sent, e.g. 'w'.
+
+        Returns:
+        - response (str): The command if it was sent, otherwise an empty string.
+        """
+        command = command.strip()
+        if serial_protocol.encode_command(command, 0) is None:
+            return ''
+
+        deadline = time.time() + self.serial_port.timeout
+        while len(self.in_flight) >= settings.SERIAL_COMMAND_WINDOW_SIZE:
+            if time.time() > deadline:
+                # Go-back-N resends did not get the oldest command through, restart the numbering on both ends
+                if not self.resynchronize():
+                    return self.send_command(command + '\n')
+                break
+            self.pending_frames.extend(self.read_frames())
+            time.sleep(0.001)
+
+        sequence = self.next_sequence
+        self.next_sequence = (self.next_sequence + 1) & 0xFF
+        self.in_flight[sequence] = [command, time.time()]
+        self.serial_port.write(serial_protocol.encode_command(command, sequence))
+        self.last_command_time = time.time()
+        return command
+
+    def send_unsequenced_command(self, command):
+        """
+        Send an idempotent binary command outside of the command window, e.g. a pose query. It takes no sequence number
+        and is not acked or resent, the MBot answers it directly and a lost one is only missed.
+
+        Args:
+        - command (str): ASCII command to be sent, e.g. 'pq:1234'.
+
+        Returns:
+        - bool: True if the command was sent.
+        """
+        frame = serial_protocol.encode_command(command, 0)
+        if not self.binary_mode or frame is None:
+            return False
+        self.serial_port.write(frame)
+        self.last_command_time = time.time()
+        return True
+
+    def resynchronize(self):
+        """
+        Negotiate the binary protocol again, which restarts the sequence numbering on both ends and switches the MBot
+        back to frames if it fell back to ASCII, then resend the commands still in flight in their order.
+        A command the MBot executed but whose ack got lost is executed again.
+
+        Returns:
+        - bool: True if the MBot is back on the binary link, otherwise both ends continue in ASCII.
+        """
+        commands = [entry[0] for entry in self.in_flight.values()]
+        self.in_flight.clear()
+        self.binary_mode = False
+        if not self.negotiate_binary_protocol():
+            self.unack_counter += len(commands)
+            return False
+        for command in commands:
+            self.send_binary_command(command)
+        return True
+
+    def send_keepalive(self):
+        """Send a hello when no binary command was sent for a while, so the MBot keeps the binary link."""
+        if self.binary_mode and time.time() - self.last_command_time >= settings.SERIAL_KEEPALIVE_INTERVAL_SECONDS:
+            self.send_command('hello')
+
+def publish_temperature(mqtt_client, temperature_value):
+    """
+    Publish a temperature reading from the MBot.
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - temperature_value (int): Temperature to publish.
+    """
+    try:
+        mqtt_client.publish(settings.TOPIC_TEMPERATURE_DATA, temperature_value)
+        print("PUB temp:",temperature_value, " - to:",settings.TOPIC_TEMPERATURE_DATA)
+    except Exception as e:
+        print(f"Publish error: {e}")
+
+def publish_telemetry(mqtt_client, topic, data):
+    """
+    Publish a telemetry sample from the MBot as JSON.
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - topic (str): Topic to publish to.
+    - data (dict): Telemetry values.
+    """
+    try:
+        mqtt_client.publish(topic, json.dumps(data))
+    except Exception as e:
+        print(f"Publish error: {e}")
+
+def pose_from_values(values):
+    """
+    Build a pose with its covariance, rebuilt from standard deviations and correlations.
+
+    Args:
+    - values (sequence): X mm, Y mm, heading in centidegrees, MBot time in ms, standard deviations of x, y in mm and heading in centidegrees, correlations xy, x heading, y heading times 127.
+
+    Returns:
+    - pose (dict): Pose ready to be published.
+    """
+    x, y, heading, time_ms, deviation_x, deviation_y, deviation_heading, correlation_xy, correlation_x_heading, correlation_y_heading = values
+    deviations = [deviation_x, deviation_y, deviation_heading / 100]
+    correlations = [
+        [127, correlation_xy, correlation_x_heading],
+        [correlation_xy, 127, correlation_y_heading],
+        [correlation_x_heading, correlation_y_heading, 127],
+    ]
+    covariance = [[deviations[row] * deviations[column] * correlations[row][column] / 127 for column in range(3)] for row in range(3)]
+    return {
+        "x": x,
+        "y": y,
+        "heading": heading / 100,
+        "timestamp_ms": time_ms,
+        "covariance": covariance, # Rows and columns x, y in mm and heading in degrees
+    }
+
+class MBotClock:
+    """Class estimating the offset between the MBot millis() clock and time.monotonic() from the pose timestamps."""
+
+    def __init__(self):
+        """Initialize MBotClock object."""
+        self.offsets = deque() # (receive time, offset in ms) of the poses received in the window
+
+    def update(self, mbot_time_ms):
+        """
+        Add the MBot time of a pose that was just received.
+
+        Args:
+        - mbot_time_ms (int): MBot time of the pose in ms.
+        """
+        now = time.monotonic()
+        self.offsets.append((now, now * 1000 - mbot_time_ms))
+        while self.offsets[0][0] < now - settings.MBOT_CLOCK_WINDOW_SECONDS:
+            self.offsets.popleft()
+
+    def to_mbot_time(self, monotonic_time):
+        """
+        Convert a time.monotonic() time to MBot time, using the pose with the least transmission delay.
+
+        Args:
+        - monotonic_time (float): Time in seconds from time.monotonic().
+
+        Returns:
+        - mbot_time_ms (int or None): MBot time in ms, or None if no pose was received yet.
+        """
+        if not self.offsets:
+            return None
+        offset = min(offset for _, offset in self.offsets)
+        return int(monotonic_time * 1000 - offset) & 0xFFFFFFFF
+
+mbot_clock = MBotClock()
+pending_pose_queries = {} # MBot time in ms -> (frame number, time the query was sent)
+
+def publish_pose(mqtt_client, values):
+    """
+    Publish an odometry pose of the MBot with its covariance and use its time to follow the MBot clock.
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - values (sequence): Pose fields, see pose_from_values().
+    """
+    pose = pose_from_values(values)
+    mbot_clock.update(pose["timestamp_ms"])
+    publish_telemetry(mqtt_client, settings.TOPIC_POSE_DATA, pose)
+
+def query_frame_poses(serial_comm, pose_queries):
+    """
+    Ask the MBot for the pose at the capture time of every new camera frame and drop unanswered queries.
+
+    Args:
+    - serial_comm (SerialCommunication): SerialCommunication instance.
+    - pose_queries (queue.Queue): (frame number, time.monotonic() capture time) of the published frames.
+    """
+    now = time.monotonic()
+    for mbot_time, (_, sent_time) in list(pending_pose_queries.items()):
+        if now - sent_time > settings.POSE_QUERY_TIMEOUT_SECONDS:
+            del pending_pose_queries[mbot_time]
+
+    while not pose_queries.empty():
+        frame_number, capture_time = pose_queries.get_nowait()
+        mbot_time = mbot_clock.to_mbot_time(capture_time)
+        if mbot_time is None or now - capture_time > settings.POSE_QUERY_TIMEOUT_SECONDS:
+            continue # No pose received yet to follow the MBot clock, or the frame waited too long
+        pending_pose_queries[mbot_time] = (frame_number, now)
+        # Queries are answered directly, so they do not take window slots from the drive commands
+        serial_comm.send_unsequenced_command(f"{settings.POSE_QUERY_COMMAND}{mbot_time}")
+
+def discard_pose_queries(pose_queries):
+    """
+    Drop the camera frames waiting for a pose query, used on the ASCII link where no queries are sent.
+
+    Args:
+    - pose_queries (queue.Queue): (frame number, time.monotonic() capture time) of the published frames.
+    """
+    while not pose_queries.empty():
+        pose_queries.get_nowait()
+
+def publish_pose_history(mqtt_client, values):
+    """
+    Publish the answer to a pose query as the pose of the camera frame it was asked for.
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - values (sequence): Query status followed by the pose fields, see pose_from_values().
+    """
+    status = values[0]
+    pose = pose_from_values(values[1:])
+    query = pending_pose_queries.pop(pose["timestamp_ms"], None)
+    if query is None:
+        return # Timed out or asked before a restart
+    pose["frame"] = query[0]
+    pose["status"] = settings.POSE_QUERY_STATUS_NAMES[status] if status < len(settings.POSE_QUERY_STATUS_NAMES) else status
+    publish_telemetry(mqtt_client, settings.TOPIC_CAMERA_POSE_DATA, pose)
+
+def publish_serial_diagnostics(mqtt_client, values):
+    """
+    Publish and print the serial port error counters of the MBot.
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - values (sequence): Overruns, framing errors, rx buffer overflows, rx high-water mark, tx high-water mark, dropped tx messages, frame errors.
+    """
+    diagnostics = dict(zip(["rx_overruns", "rx_framing_errors", "rx_buffer_overflows", "rx_high_water_mark", "tx_high_water_mark", "tx_dropped_messages", "frame_errors"], values))
+    if diagnostics["rx_overruns"] or diagnostics["rx_framing_errors"] or diagnostics["rx_buffer_overflows"]:
+        print("MBot serial port lost bytes:", diagnostics)
+    publish_telemetry(mqtt_client, settings.TOPIC_SERIAL_DIAGNOSTICS_DATA, diagnostics)
+
+def publish_profile(mqtt_client, values):
+    """
+    Publish the run time profile of one MBot section.
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - values (sequence): Section, samples, min, max and mean in microseconds, followed by the histogram buckets.
+    """
+    section = values[0]
+    if section < len(settings.PROFILE_SECTION_NAMES):
+        section = settings.PROFILE_SECTION_NAMES[section]
+    histogram_limits = [settings.PROFILE_HISTOGRAM_FIRST_BUCKET_US << bucket for bucket in range(len(values) - 6)]
+    publish_telemetry(mqtt_client, settings.TOPIC_PROFILE_DATA, {
+        "section": section,
+        "samples": values[1],
+        "min_us": values[2],
+        "max_us": values[3],
+        "mean_us": values[4],
+        "histogram_limits_us": histogram_limits, # Upper limit of every bucket but the last
+        "histogram": list(values[5:]),
+    })
+
+autotune_captures = {}
+
+def collect_autotune_sample(values):
+    """
+    Store one sample of an MBot autotune capture until the result of the wheel arrives.
+
+    Args:
+    - values (sequence): Encoder, index, Timer5 ticks, PWM, pulses since the step.
+    """
+    encoder, index, ticks, pwm, pulses = values
+    capture = autotune_captures.setdefault(encoder, [])
+    if index == 0:
+        capture.clear()
+    capture.append((ticks, pwm, pulses))
+
+def publish_autotune_result(mqtt_client, values):
+    """
+    Publish the autotune result of one wheel together with its capture, with the timer ticks unwrapped to seconds.
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - values (sequence): Encoder, status, steady speed, dead time ms, time constant ms, kp, ki and feedforward times 1000.
+    """
+    encoder, status, steady_speed, dead_time_ms, time_constant_ms, kp, ki, feedforward = values
+    if status < len(settings.AUTOTUNE_STATUS_NAMES):
+        status = settings.AUTOTUNE_STATUS_NAMES[status]
+    times, elapsed_ticks = [], 0
+    capture = autotune_captures.pop(encoder, [])
+    for i, (ticks, _, _) in enumerate(capture):
+        if i > 0:
+            elapsed_ticks += (ticks - capture[i - 1][0]) & 0xFFFF
+        times.append(elapsed_ticks * settings.AUTOTUNE_TICK_MICROSECONDS / 1e6)
+    result = {
+        "encoder": encoder,
+        "status": status,
+        "steady_speed_mm_s": steady_speed,
+        "dead_time_ms": dead_time_ms,
+        "time_constant_ms": time_constant_ms,
+        "kp": kp / 1000,
+        "ki": ki / 1000,
+        "feedforward": feedforward / 1000,
+        "time_s": times,
+        "pwm": [sample[1] for sample in capture],
+        "pulses": [sample[2] for sample in capture],
+    }
+    print("MBot autotune:", {key: value for key, value in result.items() if not isinstance(value, list)})
+    publish_telemetry(mqtt_client, settings.TOPIC_AUTOTUNE_DATA, result)
+
+def publish_calibration_result(mqtt_client, values):
+    """
+    Publish and print the result of an MBot wheel geometry calibration.
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - values (sequence): Status, right and left mm per pulse in 10 nm, track width in 0.1 mm, rotation in 0.1 degrees, heading drift in centidegrees.
+    """
+    status, right_pulse_length, left_pulse_length, track_width, rotation, heading_drift = values
+    if status < len(settings.CALIBRATION_STATUS_NAMES):
+        status = settings.CALIBRATION_STATUS_NAMES[status]
+    result = {
+        "status": status,
+        "right_mm_per_pulse": right_pulse_length / 100000,
+        "left_mm_per_pulse": left_pulse_length / 100000,
+        "track_width_mm": track_width / 10,
+        "rotation_degrees": rotation / 10,
+        "heading_drift_degrees": heading_drift / 100,
+    }
+    print("MBot calibration:", result)
+    publish_telemetry(mqtt_client, settings.TOPIC_CALIBRATION_DATA, result)
+
+def publish_pwm_speed_table(mqtt_client, values):
+    """
+    Publish and print the speeds measured by an MBot PWM sweep for one wheel in one direction.
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - values (sequence): Encoder, PWM direction, speed in mm/s at every PWM level.
+    """
+    encoder, direction = values[0], values[1]
+    speeds = list(values[2:])
+    levels = len(speeds) - 1
+    table = {
+        "encoder": encoder,
+        "direction": direction,
+        "pwm": [direction * round(level * 255 / levels) for level in range(levels + 1)],
+        "speed_mm_s": speeds,
+    }
+    print("MBot PWM table:", table)
+    publish_telemetry(mqtt_client, settings.TOPIC_PWM_SPEED_TABLE_DATA, table)
+
+def handle_binary_telemetry(mqtt_client, message_type, payload):
+    """
+    Publish a binary telemetry frame (other than temperature).
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - message_type (int): Message type of the frame.
+    - payload (bytes): Payload of the frame.
+
+    Returns:
+    - bool: True if the frame was a telemetry frame.
+    """
+    try:
+        if message_type == serial_protocol.MSG_ENCODERS:
+            encoder_1, encoder_2 = serial_protocol.ENCODERS_FORMAT.unpack(payload)
+            publish_telemetry(mqtt_client, settings.TOPIC_ENCODER_DATA, {"encoder_1": encoder_1, "encoder_2": encoder_2})
+        elif message_type == serial_protocol.MSG_GYRO:
+            yaw, = serial_protocol.GYRO_FORMAT.unpack(payload)
+            publish_telemetry(mqtt_client, settings.TOPIC_GYRO_DATA, {"yaw": yaw / 100})
+        elif message_type == serial_protocol.MSG_POSE:
+            publish_pose(mqtt_client, serial_protocol.POSE_FORMAT.unpack(payload))
+        elif message_type == serial_protocol.MSG_LOOP_STATS:
+            loops_per_second, max_loop_time, task_overruns = serial_protocol.LOOP_STATS_FORMAT.unpack(payload)
+            publish_telemetry(mqtt_client, settings.TOPIC_LOOP_STATS_DATA, {"loops_per_second": loops_per_second, "max_loop_time_us": max_loop_time, "task_overruns": task_overruns})
+        elif message_type == serial_protocol.MSG_PROFILE:
+            publish_profile(mqtt_client, serial_protocol.PROFILE_FORMAT.unpack(payload))
+        elif message_type == serial_protocol.MSG_SERIAL_DIAGNOSTICS:
+            publish_serial_diagnostics(mqtt_client, serial_protocol.SERIAL_DIAGNOSTICS_FORMAT.unpack(payload))
+        elif message_type == serial_protocol.MSG_AUTOTUNE_SAMPLE:
+            collect_autotune_sample(serial_protocol.AUTOTUNE_SAMPLE_FORMAT.unpack(payload))
+        elif message_type == serial_protocol.MSG_AUTOTUNE_RESULT:
+            publish_autotune_result(mqtt_client, serial_protocol.AUTOTUNE_RESULT_FORMAT.unpack(payload))
+        elif message_type == serial_protocol.MSG_CALIBRATION_RESULT:
+            publish_calibration_result(mqtt_client, serial_protocol.CALIBRATION_RESULT_FORMAT.unpack(payload))
+        elif message_type == serial_protocol.MSG_PWM_SPEED_TABLE:
+            publish_pwm_speed_table(mqtt_client, serial_protocol.PWM_SPEED_TABLE_FORMAT.unpack(payload))
+        elif message_type == serial_protocol.MSG_POSE_HISTORY:
+            publish_pose_history(mqtt_client, serial_protocol.POSE_HISTORY_FORMAT.unpack(payload))
+        else:
+            return False
+    except Exception as e:
+        print("\nBad telemetry frame:", message_type, payload, e, "\n")
+    return True
+
+def handle_ascii_telemetry(mqtt_client, line):
+    """
+    Publish an ASCII telemetry line (other than temperature), e.g. "p:120,-40,9000".
+
+    Args:
+    - mqtt_client (MQTTClient): MQTTClient instance.
+    - line (str): Line received from the MBot.
+
+    Returns:
+    - bool: True if the line was a telemetry line.
+    """
+    prefix, _, values = line.partition(':')
+    prefix += ':'
+    try:
+        values = [int(value) for value in values.split(',')]
+        if prefix == settings.TELEMETRY_ENCODERS_COMMAND:
+            publish_telemetry(mqtt_client, settings.TOPIC_ENCODER_DATA, {"encoder_1": values[0], "encoder_2": values[1]})
+        elif prefix == settings.TELEMETRY_GYRO_COMMAND:
+            publish_telemetry(mqtt_client, settings.TOPIC_GYRO_DATA, {"yaw": values[0] / 100})
+        elif prefix == settings.TELEMETRY_POSE_COMMAND:
+            publish_pose(mqtt_client, values)
+        elif prefix == settings.TELEMETRY_LOOP_STATS_COMMAND:
+            publish_telemetry(mqtt_client, settings.TOPIC_LOOP_STATS_DATA, {"loops_per_second": values[0], "max_loop_time_us": values[1], "task_overruns": values[2]})
+        elif prefix == settings.PROFILE_COMMAND:
+            publish_profile(mqtt_client, values)
+        elif prefix == settings.SERIAL_DIAGNOSTICS_COMMAND:
+            publish_serial_diagnostics(mqtt_client, values)
+        elif prefix == settings.AUTOTUNE_SAMPLE_COMMAND:
+            collect_autotune_sample(values)
+        elif prefix == settings.AUTOTUNE_RESULT_COMMAND:
+            publish_autotune_result(mqtt_client, values)
+        elif prefix == settings.CALIBRATION_RESULT_COMMAND:
+            publish_calibration_result(mqtt_client, values)
+        elif prefix == settings.PWM_SPEED_TABLE_COMMAND:
+            publish_pwm_speed_table(mqtt_client, values)
+        elif prefix == settings.POSE_HISTORY_COMMAND:
+            publish_pose_history(mqtt_client, values)
+        else:
+            return False
+    except (ValueError, IndexError):
+        return False
+    return True
+
+def set_telemetry_periods(serial_comm):
+    """
+    Send the telemetry stream periods from settings to the MBot.
+
+    Args:
+    - serial_comm (SerialCommunication): SerialCommunication instance.
+    """
+    for stream, period_ms in settings.TELEMETRY_PERIODS_MS.items():
+        serial_comm.send_command(f"{settings.TELEMETRY_RATE_COMMAND}{stream},{period_ms}\n")
+
 def show_that_connection_to_mbot_is_set(serial_comm):
     """
     Show a connection indication to mBot via serial communication.
@@ -60,36 +597,71 @@ def show_that_connection_to_mbot_is_set(serial_comm):
     time.sleep(settings.SERIAL_THREAD_SLEEP_TIME_IN_SECONDS)
     serial_comm.send_command(set_motor_speed_medium)
 
-def run_serial(mqtt_client):
+def run_serial(mqtt_client, pose_queries=None):
     """
     Run the serial communication thread.
 
     Args:
     - mqtt_client (MQTTClient): MQTTClient instance.
+    - pose_queries (queue.Queue, optional): Camera frames to ask the MBot pose for. Defaults to None.
     """
     try:
         serial_comm = SerialCommunication(port=settings.RPI_USB_PORT)
-        show_that_connection_to_mbot_is_set(serial_comm)
     except Exception as e:
         # If the RPI serial port is not found, try with a different port (e.g., COM3, may be on windows)
         try:
             print("Exception: ", e)
             serial_comm = SerialCommunication(port=settings.WIN_USB_PORT)
-            show_that_connection_to_mbot_is_set(serial_comm)
         except Exception as e2:
             print("Exception: ", e2)
             return  # Exit the function if no serial port is available
 
+    if settings.USE_BINARY_SERIAL_PROTOCOL:
+        time.sleep(settings.SERIAL_MBOT_BOOT_TIME_IN_SECONDS) # Opening the port resets the MBot
+        print("Binary serial protocol:", serial_comm.negotiate_binary_protocol())
+    set_telemetry_periods(serial_comm)
+    show_that_connection_to_mbot_is_set(serial_comm)
+
     last_temperature_transmission_time = time.time()  # Initialize last execution time
+    last_serial_diagnostics_request_time = time.time()
+    last_profile_request_time = time.time()
 
     # Main loop of thread
     while True:
         new_data_is_available, topic = mqtt_client.get_new_payload_available_and_what_topic()
-        if new_data_is_available and (topic == settings.TOPIC_MOTOR_CONTROL_DIRECTION or topic == settings.TOPIC_MOTOR_CONTROL_SPEED or topic == settings.TOPIC_ROBOT_STATE):
+        if new_data_is_available and (topic == settings.TOPIC_MOTOR_CONTROL_DIRECTION or topic == settings.TOPIC_MOTOR_CONTROL_SPEED or topic == settings.TOPIC_ROBOT_STATE or topic == settings.TOPIC_TELEMETRY_RATE):
             payload = mqtt_client.get_new_payload()
             command = payload.decode('utf-8') + '\n'
             response = serial_comm.send_command(command)
 
+        if (time.time() - last_serial_diagnostics_request_time) >= settings.SERIAL_DIAGNOSTICS_INTERVAL_SECONDS:
+            last_serial_diagnostics_request_time = time.time()
+            serial_comm.send_command(settings.SERIAL_DIAGNOSTICS_REQUEST_COMMAND + '\n')
+
+        if (time.time() - last_profile_request_time) >= settings.PROFILE_INTERVAL_SECONDS:
+            last_profile_request_time = time.time()
+            serial_comm.send_command(settings.PROFILE_REQUEST_COMMAND + '\n')
+
+        if pose_queries is not None:
+            if serial_comm.binary_mode:
+                query_frame_poses(serial_comm, pose_queries)
+            else:
+                discard_pose_queries(pose_queries) # An ASCII command waits for its answer, so no queries are sent
+
+        if serial_comm.binary_mode:
+            serial_comm.send_keepalive()
+            for message_type, payload in serial_comm.read_frames():
+                if message_type == serial_protocol.MSG_TEMPERATURE:
+                    current_time = time.time()
+                    if (current_time - last_temperature_transmission_time) >= settings.TEMPERATURE_UPDATE_INTERVAL_SECONDS:
+                        last_temperature_transmission_time = current_time
+                        publish_temperature(mqtt_client, serial_protocol.TEMPERATURE_FORMAT.unpack(payload)[0])
+                elif not handle_binary_telemetry(mqtt_client, message_type, payload):
+                    print("\nFrame received but not recognized:", message_type, payload, "\n")
+
+            time.sleep(settings.SERIAL_THREAD_SLEEP_TIME_IN_SECONDS)
+            continue
+
         command_received = None
 
         if serial_comm.serial_port.in_waiting > 0:
@@ -117,13 +689,10 @@ def run_serial(mqtt_client):
                         if len(parts) == 2:
                             value = parts[1].strip()  # Extract the value after "t:"
                             if value.isdigit():
-                                temperature_value = int(value)
-                                try:
-                                    mqtt_client.publish(settings.TOPIC_TEMPERATURE_DATA, temperature_value)
-                                    print("PUB temp:",temperature_value, " - to:",settings.TOPIC_TEMPERATURE_DATA)
-                                except Exception as e:
-                                    print(f"Publish error: {e}")
-                            
+                                publish_temperature(mqtt_client, int(value))
+
+                elif handle_ascii_telemetry(mqtt_client, command_received):
+                    pass
                 elif command_received.strip(): # May happen that an empty message is read somehow
                     print("\nMessage received but not recognized:", command_received, "\n")
 
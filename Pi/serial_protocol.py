@@ -0,0 +1,231 @@
+import struct
+
+# Binary framed protocol shared with the MBot (see MBot/src/protocol.h)
+# Frame: type (1 byte) + payload + CRC16 (CRC-16/MCRF4XX, little endian), COBS encoded and terminated by 0x00
+
+FRAME_DELIMITER = b'\x00'
+MAX_PAYLOAD_SIZE = 32
+
+# Message types
+MSG_COMMAND = 0x01
+MSG_ACK = 0x02
+MSG_NOK = 0x03
+MSG_TEMPERATURE = 0x10
+MSG_ENCODERS = 0x11
+MSG_GYRO = 0x12
+MSG_POSE = 0x13
+MSG_LOOP_STATS = 0x14
+MSG_SERIAL_DIAGNOSTICS = 0x15
+MSG_PROFILE = 0x16
+MSG_AUTOTUNE_SAMPLE = 0x17
+MSG_AUTOTUNE_RESULT = 0x18
+MSG_CALIBRATION_RESULT = 0x19
+MSG_PWM_SPEED_TABLE = 0x1A
+MSG_POSE_HISTORY = 0x1B
+
+# Command bytes, same order as messageRecieved_t in MBot/src/serial.h
+COMMAND_IDS = {
+    'hello': 0,
+    'r': 1,
+    'c': 2,
+    'w': 3,
+    's': 4,
+    'a': 5,
+    'd': 6,
+    'h': 7,
+    'm': 8,
+    'l': 9,
+    'hello:b': 10,
+    'tr': 11,
+    'diag': 12,
+    'prof': 13,
+    'tune': 14,
+    'cal': 15,
+    'sweep': 16,
+    'pq': 17,
+    'bench': 18,
+}
+
+# Commands taking arguments, sent in ASCII as "<command>:<value>,<value>"
+COMMAND_ARGUMENT_FORMATS = {
+    'tr': struct.Struct('<BH'), # Telemetry stream, period in ms
+    'pq': struct.Struct('<I'), # MBot time in ms
+}
+
+# Fixed payload layouts
+TEMPERATURE_FORMAT = struct.Struct('<h')
+ENCODERS_FORMAT = struct.Struct('<ii')
+GYRO_FORMAT = struct.Struct('<h') # Yaw in centidegrees
+POSE_FORMAT = struct.Struct('<hhhIHHHbbb') # X mm, Y mm, heading in centidegrees, MBot time ms, standard deviations of x, y mm and heading centidegrees, correlations xy, x heading, y heading times 127
+LOOP_STATS_FORMAT = struct.Struct('<HHH') # Loops per second, longest loop in us, scheduler task overruns
+SERIAL_DIAGNOSTICS_FORMAT = struct.Struct('<7H')
+PROFILE_FORMAT = struct.Struct('<B4H10H') # Section, samples, min, max, mean in us, 10 histogram buckets
+AUTOTUNE_SAMPLE_FORMAT = struct.Struct('<BHHhh') # Encoder, index, Timer5 ticks (4 us, wrapping), PWM, pulses since the step
+AUTOTUNE_RESULT_FORMAT = struct.Struct('<BBhHHhhh') # Encoder, status, steady speed mm/s, dead time ms, time constant ms, kp, ki, feedforward times 1000
+CALIBRATION_RESULT_FORMAT = struct.Struct('<BHHHhh') # Status, right and left mm per pulse in 10 nm, track width in 0.1 mm, rotation in 0.1 degrees, heading drift in centidegrees
+PWM_SPEED_TABLE_FORMAT = struct.Struct('<Bb9h') # Encoder, PWM direction, speed mm/s at the 9 evenly spaced PWM levels from 0 to 255
+POSE_HISTORY_FORMAT = struct.Struct('<BhhhIHHHbbb') # Query status followed by the POSE_FORMAT fields, the time is the asked MBot time
+
+
+def crc16(data):
+    """
+    Calculate the CRC-16/MCRF4XX of data, same as _crc_ccitt_update() in avr-libc starting at 0xFFFF.
+
+    Args:
+    - data (bytes): Data to calculate the CRC of.
+
+    Returns:
+    - crc (int): The CRC16 value.
+    """
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            if crc & 1:
+                crc = (crc >> 1) ^ 0x8408
+            else:
+                crc >>= 1
+    return crc
+
+
+def cobs_encode(data):
+    """
+    COBS encode data so that it contains no 0x00 bytes.
+
+    Args:
+    - data (bytes): Data to encode.
+
+    Returns:
+    - encoded (bytes): Encoded data, without delimiter.
+    """
+    encoded = bytearray()
+    block = bytearray()
+    for byte in data:
+        if byte == 0:
+            encoded.append(len(block) + 1)
+            encoded.extend(block)
+            block = bytearray()
+        else:
+            block.append(byte)
+            if len(block) == 254:
+                encoded.append(255)
+                encoded.extend(block)
+                block = bytearray()
+    encoded.append(len(block) + 1)
+    encoded.extend(block)
+    return bytes(encoded)
+
+
+def cobs_decode(data):
+    """
+    Decode COBS encoded data.
+
+    Args:
+    - data (bytes): Encoded data, without delimiter.
+
+    Returns:
+    - decoded (bytes or None): Decoded data, or None if the encoding is invalid.
+    """
+    decoded = bytearray()
+    index = 0
+    while index < len(data):
+        code = data[index]
+        if code == 0 or index + code > len(data):
+            return None
+        decoded.extend(data[index + 1:index + code])
+        index += code
+        if code != 255 and index < len(data):
+            decoded.append(0)
+    return bytes(decoded)
+
+
+def encode_frame(message_type, payload=b''):
+    """
+    Build a complete frame ready to be written to the serial port.
+
+    Args:
+    - message_type (int): Message type.
+    - payload (bytes, optional): Fixed-layout payload. Defaults to empty.
+
+    Returns:
+    - frame (bytes): COBS encoded frame including the delimiter.
+    """
+    raw = bytes([message_type]) + payload
+    raw += struct.pack('<H', crc16(raw))
+    return cobs_encode(raw) + FRAME_DELIMITER
+
+
+def encode_command(command, sequence):
+    """
+    Build a command frame from an ASCII command, arguments are packed in their fixed layout.
+
+    Args:
+    - command (str): ASCII command, e.g. 'w' or 'tr:3,200'.
+    - sequence (int): Sequence number of the command (0-255).
+
+    Returns:
+    - frame (bytes or None): Encoded frame, or None if the command or its arguments are invalid.
+    """
+    command = command.strip()
+    arguments = b''
+    if command not in COMMAND_IDS:
+        command, _, values = command.partition(':')
+        argument_format = COMMAND_ARGUMENT_FORMATS.get(command)
+        if argument_format is None:
+            return None
+        try:
+            arguments = argument_format.pack(*(int(value) for value in values.split(',')))
+        except (ValueError, struct.error):
+            return None
+    return encode_frame(MSG_COMMAND, bytes([sequence & 0xFF, COMMAND_IDS[command]]) + arguments)
+
+
+def is_sequence_acked(sequence, ack_sequence):
+    """
+    Check if a sequence number is covered by a cumulative ack, taking the 8-bit wrap-around into account.
+
+    Args:
+    - sequence (int): Sequence number of a sent command.
+    - ack_sequence (int): Sequence number in the cumulative ack.
+
+    Returns:
+    - bool: True if the command is acknowledged by the ack.
+    """
+    return ((ack_sequence - sequence) & 0xFF) < 128
+
+
+class FrameReader:
+    """Class collecting received bytes and splitting them into checked frames."""
+
+    def __init__(self):
+        """Initialize FrameReader object."""
+        self.buffer = bytearray()
+        self.error_counter = 0
+
+    def feed(self, data):
+        """
+        Add received bytes and return all frames completed by them.
+
+        Args:
+        - data (bytes): Bytes read from the serial port.
+
+        Returns:
+        - frames (list): List of (message_type, payload) tuples with valid CRC.
+        """
+        frames = []
+        self.buffer.extend(data)
+        while True:
+            end = self.buffer.find(FRAME_DELIMITER)
+            if end < 0:
+                break
+            encoded = bytes(self.buffer[:end])
+            del self.buffer[:end + 1]
+            if not encoded:
+                continue
+
+            raw = cobs_decode(encoded)
+            if raw is None or len(raw) < 3 or struct.unpack('<H', raw[-2:])[0] != crc16(raw[:-2]):
+                self.error_counter += 1
+                continue
+            frames.append((raw[0], raw[1:-2]))
+        return frames
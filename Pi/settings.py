@@ -16,11 +16,61 @@ CAMERA_PRINCIPAL_POINT_SETTING = (607.1928, 185.2157)
 RPI_USB_PORT = '/dev/ttyUSB0'
 WIN_USB_PORT = 'COM3'
 SERIAL_THREAD_SLEEP_TIME_IN_SECONDS = (1/20)
+USE_BINARY_SERIAL_PROTOCOL = True # COBS framed binary protocol, negotiated with BINARY_HELLO_COMMAND
+BINARY_HELLO_COMMAND = 'hello:b'
+SERIAL_MBOT_BOOT_TIME_IN_SECONDS = 2
+SERIAL_COMMAND_WINDOW_SIZE = 8 # Binary commands in flight before waiting for acks, must be below 128
+SERIAL_ACK_TIMEOUT_IN_SECONDS = 0.2 # Unacked binary commands are resent after this time
+SERIAL_KEEPALIVE_INTERVAL_SECONDS = 1 # A binary link idle this long gets a hello, the MBot falls back to ASCII after SERIAL_BINARY_LINK_TIMEOUT_MS (5 s) without frames
 #COMMANDS
 STATE_COMMANDS = ['r', 'c'] # R - Remain, C - Manual Control
 MOTOR_SPEED_COMMANDS = ['h', 'm', 'l'] # H - High, M - Medium, L - Low
 MOTOR_DIRECTION_COMMANDS = ['w', 'd', 's', 'a'] # 1 - Forward, 2 - Right, 3 - Back, 4 - Left
 TEMPERATURE_COMMAND = 't:'
+TELEMETRY_ENCODERS_COMMAND = 'e:'
+TELEMETRY_GYRO_COMMAND = 'g:'
+TELEMETRY_POSE_COMMAND = 'p:'
+TELEMETRY_LOOP_STATS_COMMAND = 'ls:'
+SERIAL_DIAGNOSTICS_COMMAND = 'u:'
+SERIAL_DIAGNOSTICS_REQUEST_COMMAND = 'diag'
+SERIAL_DIAGNOSTICS_INTERVAL_SECONDS = 10 # How often the MBot serial port error counters are requested
+PROFILE_COMMAND = 'pf:'
+PROFILE_REQUEST_COMMAND = 'prof'
+PROFILE_INTERVAL_SECONDS = 5 # How often the MBot run time profile is requested, each report covers the time since the last one
+# Profiled sections (same order as profileSection_t in MBot/src/profiler.h)
+PROFILE_SECTION_NAMES = ['loop', 'task_lateness', 'serial', 'motor_control', 'encoders', 'gyro', 'move_loop', 'led_show', 'telemetry', 'localization']
+PROFILE_HISTOGRAM_FIRST_BUCKET_US = 16 # Every next bucket doubles the limit, the last bucket counts the rest
+AUTOTUNE_REQUEST_COMMAND = 'tune' # Publish to TOPIC_ROBOT_STATE in standby, the robot should be lifted
+AUTOTUNE_SAMPLE_COMMAND = 'at:'
+AUTOTUNE_RESULT_COMMAND = 'ar:'
+AUTOTUNE_STATUS_NAMES = ['ok', 'no_movement', 'wrong_direction'] # Same order as autotuneStatus_t in MBot/src/autotune.h
+AUTOTUNE_TICK_MICROSECONDS = 4
+CALIBRATION_REQUEST_COMMAND = 'cal' # Publish to TOPIC_ROBOT_STATE in standby, the robot needs about a meter of free floor in front
+CALIBRATION_RESULT_COMMAND = 'cr:'
+CALIBRATION_STATUS_NAMES = ['ok', 'no_rotation', 'out_of_range'] # Same order as calibrationStatus_t in MBot/src/calibration.h
+PWM_SWEEP_REQUEST_COMMAND = 'sweep' # Publish to TOPIC_ROBOT_STATE in standby, the robot should be lifted
+PWM_SPEED_TABLE_COMMAND = 'pt:'
+FIXED_POINT_BENCHMARK_COMMAND = 'bench' # Publish to TOPIC_ROBOT_STATE in standby, ASCII link only, the results are printed as text
+POSE_QUERY_COMMAND = 'pq:' # "pq:<MBot time ms>", answered with the pose at that time from the MBot pose history
+POSE_HISTORY_COMMAND = 'ph:'
+POSE_QUERY_STATUS_NAMES = ['ok', 'too_old', 'too_new'] # Same order as poseQueryStatus_t in MBot/src/pose_history.h
+POSE_QUERY_TIMEOUT_SECONDS = 1 # Unanswered pose queries, and frames waiting this long to be queried, are dropped
+POSE_QUERY_QUEUE_SIZE = 8 # Frames waiting for the serial thread to ask their pose, newer frames are dropped when it is full
+MBOT_CLOCK_WINDOW_SECONDS = 10 # The MBot clock offset is taken from the least delayed pose received in this time
+TELEMETRY_RATE_COMMAND = 'tr:' # "tr:<stream>,<period ms>", period 0 turns the stream off
+#TELEMETRY STREAMS (same order as telemetryStream_t in MBot/src/telemetry.h) and their periods sent at startup
+TELEMETRY_TEMPERATURE = 0
+TELEMETRY_ENCODERS = 1
+TELEMETRY_GYRO = 2
+TELEMETRY_POSE = 3
+TELEMETRY_LOOP_STATS = 4
+TELEMETRY_PERIODS_MS = {
+    TELEMETRY_TEMPERATURE: 1000,
+    TELEMETRY_ENCODERS: 0,
+    TELEMETRY_GYRO: 0,
+    TELEMETRY_POSE: 200,
+    TELEMETRY_LOOP_STATS: 1000,
+}
 ALL_COMMANDS = [STATE_COMMANDS, MOTOR_SPEED_COMMANDS, MOTOR_DIRECTION_COMMANDS]
 
 # MQTT
@@ -40,8 +90,19 @@ TOPIC_ROBOT_STATE = "robot/state"
 TOPIC_MOTOR_CONTROL_SPEED = "motor-control/speed"
 TOPIC_MOTOR_CONTROL_DIRECTION = "motor-control/direction"
 TOPIC_CAMERA_DATA = "camera/data"
+TOPIC_CAMERA_POSE_DATA = "camera/pose" # MBot pose at the capture time of the frames published on TOPIC_CAMERA_DATA
 #TOPIC_SLAM_DATA = "slam/data" # Not used if SLAM is processed on the frame being published instead - can be used if SLAM is to be processed on the Pi
 TOPIC_TEMPERATURE_DATA = "temperature/data"
+TOPIC_ENCODER_DATA = "encoder/data"
+TOPIC_GYRO_DATA = "gyro/data"
+TOPIC_POSE_DATA = "pose/data" # Wheel odometry with its MBot time and covariance
+TOPIC_LOOP_STATS_DATA = "diagnostics/loop"
+TOPIC_SERIAL_DIAGNOSTICS_DATA = "diagnostics/serial"
+TOPIC_PROFILE_DATA = "diagnostics/profile"
+TOPIC_AUTOTUNE_DATA = "diagnostics/autotune" # Capture and result of one wheel
+TOPIC_CALIBRATION_DATA = "diagnostics/calibration"
+TOPIC_PWM_SPEED_TABLE_DATA = "diagnostics/pwm_table" # Speeds of one wheel in one direction
+TOPIC_TELEMETRY_RATE = "telemetry/rate" # Payload "tr:<stream>,<period ms>" is forwarded to the MBot
 
 #PUBLISHER
 PUBLISHER_THREAD_SLEEP_TIME_IN_SECONDS = (1/10)